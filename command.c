@@ -0,0 +1,77 @@
+#include "command.h"
+#include "hal.h"
+
+#include <stdint.h>
+
+#define NO_COMMAND 0xFF
+
+static const struct Command *commands;
+static unsigned char cmd_index[CMD_INDEX_LEN]; // position in commands
+
+static unsigned int slot_of(unsigned long key) {
+    // every character moves the top bits of the 32 bit product
+    return (unsigned int)((uint32_t)(key * CMD_HASH_MUL) >> (32 - CMD_INDEX_LOG2));
+}
+
+static void clear_index(void) {
+    for (int i = 0; i < CMD_INDEX_LEN; ++i) {
+        cmd_index[i] = NO_COMMAND;
+    }
+}
+
+int cmd_init(const struct Command *table, int n_commands) {
+    commands = table;
+    clear_index();
+    if (n_commands > CMD_INDEX_LEN) {
+        return 0;
+    }
+    for (int i = 0; i < n_commands; ++i) {
+        const unsigned int slot = slot_of(table[i].key);
+        if (cmd_index[slot] != NO_COMMAND) {
+            clear_index();
+            return 0;
+        }
+        cmd_index[slot] = (unsigned char)i;
+    }
+    return 1;
+}
+
+const struct Command *cmd_find(unsigned long key) {
+    const unsigned char i = cmd_index[slot_of(key)];
+    if (i == NO_COMMAND || commands[i].key != key) {
+        return 0;
+    }
+    return &commands[i];
+}
+
+int cmd_run(const struct Command *cmd, const long *fields, int n_fields) {
+    if (n_fields < cmd->min_fields || n_fields > cmd->max_fields) {
+        return -1;
+    }
+    return cmd->handler(fields, n_fields);
+}
+
+int cmd_queue_push(struct CmdQueue *q, const struct Command *cmd, const parser_state *ps) {
+    const unsigned int head = q->head;
+    if (head - HAL_LOAD_ACQUIRE(&q->tail) == CMD_QUEUE_LEN) {
+        return 0;
+    }
+    struct CmdMessage *msg = &q->slots[head & (CMD_QUEUE_LEN - 1)];
+    msg->cmd = cmd;
+    msg->n_fields = ps->n_fields;
+    for (int i = 0; i < ps->n_fields; ++i) {
+        msg->fields[i] = ps->fields[i];
+    }
+    HAL_STORE_RELEASE(&q->head, head + 1);
+    return 1;
+}
+
+int cmd_queue_pop(struct CmdQueue *q, struct CmdMessage *msg) {
+    const unsigned int tail = q->tail;
+    if (HAL_LOAD_ACQUIRE(&q->head) == tail) {
+        return 0;
+    }
+    *msg = q->slots[tail & (CMD_QUEUE_LEN - 1)];
+    HAL_STORE_RELEASE(&q->tail, tail + 1);
+    return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef COMMAND_H
+#define	COMMAND_H
+
+#include "parser.h"
+
+// A command accepted on the UART. The payload schema is the number of integer
+// fields, checked before calling the handler.
+struct Command {
+    unsigned long key; // MSG_KEY() of the message type
+    int min_fields;
+    int max_fields;
+    // returns 0 if the values are valid, -1 to reply with the error message
+    int (*handler)(const long *fields, int n_fields);
+    int error; // code of the $ERR reply when the command is rejected, 0 for none
+};
+
+/*
+Builds the lookup index of a command table, which must stay alive. The keys
+are hashed (multiplicative hash, the top CMD_INDEX_LOG2 bits of key *
+CMD_HASH_MUL) in a table of 2^CMD_INDEX_LOG2 slots holding one command each,
+so a lookup is one probe and one key comparison. Returns 0, leaving the
+index empty, if two commands of the table share a slot: a new command that
+collides needs another CMD_HASH_MUL (odd) or a longer index.
+*/
+#define CMD_INDEX_LOG2 4
+#define CMD_INDEX_LEN (1 << CMD_INDEX_LOG2)
+#define CMD_HASH_MUL 0x9E3779B9UL // 2^32 / golden ratio
+int cmd_init(const struct Command *table, int n_commands);
+
+// the command of a message type key, NULL if unknown
+const struct Command *cmd_find(unsigned long key);
+
+/*
+Checks the field count against the schema and runs the handler. Returns the
+handler result, -1 if the schema does not match.
+*/
+int cmd_run(const struct Command *cmd, const long *fields, int n_fields);
+
+// a parsed command waiting to be run
+struct CmdMessage {
+    const struct Command *cmd;
+    long fields[PARSER_MAX_FIELDS];
+    int n_fields;
+};
+
+/*
+Queue of parsed commands between the RX interrupt (producer) and the main loop
+(consumer), with the same single producer single consumer contract as the
+rings in ring.h. CMD_QUEUE_LEN is a power of two.
+*/
+#define CMD_QUEUE_LEN 4
+struct CmdQueue {
+    struct CmdMessage slots[CMD_QUEUE_LEN];
+    volatile unsigned int head;
+    volatile unsigned int tail;
+};
+
+// copies the fields of the command just parsed, returns 0 if the queue is full
+int cmd_queue_push(struct CmdQueue *q, const struct Command *cmd, const parser_state *ps);
+// returns 0 if the queue is empty
+int cmd_queue_pop(struct CmdQueue *q, struct CmdMessage *msg);
+
+#endif	/* COMMAND_H */
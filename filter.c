@@ -0,0 +1,21 @@
+#include "filter.h"
+
+void movavg_reset(struct MovingAverage *f, int value) {
+    const unsigned int len = 1U << f->log2_len;
+
+    for (unsigned int i = 0; i < len; ++i) {
+        f->window[i] = value;
+    }
+    f->index = 0;
+    f->sum = (long)value * len; // a shift of a negative value is undefined
+}
+
+int movavg_update(struct MovingAverage *f, int value) {
+    const unsigned int mask = (1U << f->log2_len) - 1;
+
+    f->sum += (long)value - f->window[f->index]; // in int it overflows at full range
+    f->window[f->index] = value;
+    f->index = (f->index + 1) & mask;
+
+    return (int)(f->sum >> f->log2_len);
+}
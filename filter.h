@@ -0,0 +1,30 @@
+#ifndef FILTER_H
+#define	FILTER_H
+
+// Moving average over the last 2^log2_len samples. The sum of the window is
+// kept up to date, so every update costs the same whatever the window length:
+// the evicted sample is subtracted, the new one is added and the division is
+// a shift. The sum is a long, so windows up to 2^15 samples of 16 bit values
+// cannot overflow; that is also the longest window 1U << log2_len can index
+// with a 16 bit unsigned int, MOVING_AVERAGE_INIT fails to compile past it.
+struct MovingAverage {
+    int *window; // 2^log2_len samples
+    unsigned int log2_len;
+
+    unsigned int index; // oldest sample, the next one to be replaced
+    long sum;
+};
+
+#define MOVING_AVERAGE_INIT(storage, log2) { .window = (storage), \
+    .log2_len = (log2) + 0 * sizeof(char[(log2) >= 0 && (log2) <= 15 ? 1 : -1]) }
+
+// fills the whole window with the same value
+void movavg_reset(struct MovingAverage *f, int value);
+
+/*
+Replaces the oldest sample with value and returns the new average.
+The average is rounded towards minus infinity (arithmetic shift).
+*/
+int movavg_update(struct MovingAverage *f, int value);
+
+#endif	/* FILTER_H */
@@ -0,0 +1,37 @@
+#include "fixmath.h"
+
+#define Q15_ONE 32768L
+
+// polynomial coefficients in centidegrees
+#define ATAN_C1 4500L
+#define ATAN_C2 1402L
+#define ATAN_C3 380L
+
+int atan2_cdeg(int y, int x) {
+    // long so that -32768 can be negated
+    const long ax = x < 0 ? -(long)x : x;
+    const long ay = y < 0 ? -(long)y : y;
+
+    if (ax == 0 && ay == 0) {
+        return 0;
+    }
+
+    // z = min / max in Q15, in [0, 1]
+    const long z = ay > ax ? (ax << 15) / ay : (ay << 15) / ax;
+
+    const long poly = ATAN_C2 + ((ATAN_C3 * z) >> 15);
+    const long z_one_minus_z = (z * (Q15_ONE - z)) >> 15;
+    long angle = (ATAN_C1 * z + z_one_minus_z * poly + (1L << 14)) >> 15; // rounded
+
+    // back to the original octant
+    if (ay > ax) {
+        angle = 9000 - angle;
+    }
+    if (x < 0) {
+        angle = 18000 - angle;
+    }
+    if (y < 0) {
+        angle = -angle;
+    }
+    return (int)angle;
+}
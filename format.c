@@ -0,0 +1,230 @@
+#include "format.h"
+#include "hal.h"
+
+#define MAX_DIGITS 10 // 2^31 has 10 digits
+
+// the digits are produced by subtracting powers of ten, the dsPIC has no
+// fast 32 bit division
+static const unsigned long pow10[MAX_DIGITS] = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL,
+    10000UL, 1000UL, 100UL, 10UL, 1UL,
+};
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static int checksum_enabled;
+static int mode = FORMAT_TEXT;
+static unsigned int mode_switches; // see OutLane.mode_switches
+
+// binary frame type of every message type, the number of values is fixed
+static const struct {
+    const char *type;
+    unsigned char frame;
+    unsigned char n_values;
+} frame_types[] = {
+    {"MAG", FORMAT_FRAME_MAG, 3},
+    {"YAW", FORMAT_FRAME_YAW, 1},
+    {"ERR", FORMAT_FRAME_ERR, 1},
+    {"STAT", FORMAT_FRAME_STAT, 5},
+    {"DROP", FORMAT_FRAME_DROP, N_LANES},
+    {"RX", FORMAT_FRAME_RX, 5},
+};
+
+#define N_FRAME_TYPES (int)(sizeof(frame_types) / sizeof(frame_types[0]))
+
+// of the next binary frame of every type, the lanes reorder the types. The
+// frames are written by the main loop and by the DMA interrupt (mailbox
+// lanes), a number is claimed with the interrupts disabled
+static unsigned char sequence[N_FRAME_TYPES];
+
+/*
+COBS encoder writing into the staged part of the ring: every run of non zero
+bytes is preceded by a code byte with its length + 1, whose slot is reserved
+when the run starts and filled when it ends.
+*/
+struct Cobs {
+    struct ring *buff;
+    unsigned int n; // bytes staged, code bytes included
+    unsigned int code_at; // slot of the code byte of the current run
+    unsigned char code;
+};
+
+static void cobs_start(struct Cobs *c, struct ring *buff, unsigned int offset) {
+    c->buff = buff;
+    c->n = offset + 1;
+    c->code_at = offset;
+    c->code = 1;
+}
+
+static void cobs_put(struct Cobs *c, unsigned char b) {
+    if (b != 0) {
+        ring_stage(c->buff, c->n++, (char)b);
+        if (++c->code != 0xFF) {
+            return;
+        }
+    }
+    // end of the run: a zero, or 254 bytes without one
+    ring_stage(c->buff, c->code_at, (char)c->code);
+    c->code_at = c->n++;
+    c->code = 1;
+}
+
+// closes the last run and appends the frame delimiter, returns the length
+static unsigned int cobs_end(struct Cobs *c) {
+    ring_stage(c->buff, c->code_at, (char)c->code);
+    ring_stage(c->buff, c->n++, 0);
+    return c->n;
+}
+
+void format_set_checksum(int enabled) {
+    checksum_enabled = enabled;
+}
+
+void format_set_mode(int new_mode) {
+    // the DMA interrupt must not see the new mode with the old count
+    int saved;
+    HAL_IRQ_DISABLE(saved);
+    if (new_mode != mode) {
+        ++mode_switches;
+    }
+    mode = new_mode;
+    HAL_IRQ_RESTORE(saved);
+}
+
+int format_mode(void) {
+    return mode;
+}
+
+// stages a byte of the body, between '$' and '*', updating the checksum
+static void stage(struct ring *buff, unsigned int *n, unsigned char *sum, char c) {
+    ring_stage(buff, (*n)++, c);
+    *sum ^= (unsigned char)c;
+}
+
+static unsigned long magnitude(long value) {
+    // computed in unsigned arithmetic so that LONG_MIN does not overflow
+    return value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+}
+
+static int count_digits(unsigned long v) {
+    int n = 1;
+    while (n < MAX_DIGITS && v >= pow10[MAX_DIGITS - 1 - n]) {
+        ++n;
+    }
+    return n;
+}
+
+static int same_type(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        ++a;
+        ++b;
+    }
+    return *a == *b;
+}
+
+static int print_frame(struct OutLane *lane, const char *type, const long *values, int n_values) {
+    int t = 0;
+    while (t < N_FRAME_TYPES && !same_type(frame_types[t].type, type)) {
+        ++t;
+    }
+    if (t == N_FRAME_TYPES || n_values != frame_types[t].n_values) {
+        return 0;
+    }
+
+    // the text queued in the lane before the first frame would be decoded as
+    // part of it, a delimiter goes before it
+    const int frame_start = lane->mode_switches != mode_switches;
+
+    // type, sequence, values, checksum; the frames are shorter than 254
+    // bytes so COBS adds one code byte, plus the delimiter
+    const unsigned int len = 2 + 2 * n_values + (checksum_enabled ? 1 : 0);
+    if (!outq_reserve(lane, len + 2 + frame_start)) {
+        return 0;
+    }
+    struct ring *buff = lane->ring;
+
+    int saved;
+    HAL_IRQ_DISABLE(saved);
+    const unsigned char seq = sequence[t]++;
+    HAL_IRQ_RESTORE(saved);
+
+    struct Cobs cobs;
+    unsigned char sum = frame_types[t].frame ^ seq;
+    if (frame_start) {
+        ring_stage(buff, 0, 0);
+    }
+    cobs_start(&cobs, buff, frame_start);
+    cobs_put(&cobs, frame_types[t].frame);
+    cobs_put(&cobs, seq);
+    for (int i = 0; i < n_values; ++i) {
+        // two's complement, so the low 16 bits are the same for signed and
+        // unsigned values
+        const unsigned char lo = (unsigned char)(values[i] & 0xFF);
+        const unsigned char hi = (unsigned char)((values[i] >> 8) & 0xFF);
+        cobs_put(&cobs, lo);
+        cobs_put(&cobs, hi);
+        sum ^= lo ^ hi;
+    }
+    if (checksum_enabled) {
+        cobs_put(&cobs, sum);
+    }
+
+    outq_commit(lane, cobs_end(&cobs));
+    lane->mode_switches = mode_switches;
+    return 1;
+}
+
+static int print_text(struct OutLane *lane, const char *type, const long *values, int n_values) {
+    // '$', the type, a separator before every value, '*' and the checksum
+    int len = 2 + n_values + (checksum_enabled ? 2 : 0);
+    for (const char *c = type; *c; ++c) {
+        ++len;
+    }
+    for (int i = 0; i < n_values; ++i) {
+        len += count_digits(magnitude(values[i])) + (values[i] < 0);
+    }
+
+    if (!outq_reserve(lane, len)) {
+        return 0;
+    }
+    struct ring *buff = lane->ring;
+
+    unsigned int n = 0;
+    unsigned char sum = 0;
+    ring_stage(buff, n++, '$');
+    for (const char *c = type; *c; ++c) {
+        stage(buff, &n, &sum, *c);
+    }
+
+    for (int i = 0; i < n_values; ++i) {
+        stage(buff, &n, &sum, ',');
+        if (values[i] < 0) {
+            stage(buff, &n, &sum, '-');
+        }
+
+        unsigned long v = magnitude(values[i]);
+        for (int p = MAX_DIGITS - count_digits(v); p < MAX_DIGITS; ++p) {
+            char digit = '0';
+            while (v >= pow10[p]) {
+                v -= pow10[p];
+                ++digit;
+            }
+            stage(buff, &n, &sum, digit);
+        }
+    }
+    ring_stage(buff, n++, '*');
+    if (checksum_enabled) {
+        ring_stage(buff, n++, hex_digits[sum >> 4]);
+        ring_stage(buff, n++, hex_digits[sum & 0x0F]);
+    }
+
+    outq_commit(lane, n);
+    return 1;
+}
+
+int print_msg(struct OutLane *lane, const char *type, const long *values, int n_values) {
+    if (mode == FORMAT_BINARY) {
+        return print_frame(lane, type, values, n_values);
+    }
+    return print_text(lane, type, values, n_values);
+}
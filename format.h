@@ -0,0 +1,49 @@
+#ifndef FORMAT_H
+#define	FORMAT_H
+
+#include "outq.h"
+
+// encodings of the output messages, see format_set_mode()
+#define FORMAT_TEXT 0
+#define FORMAT_BINARY 1
+
+/*
+Binary frames carry the same messages with a fixed layout:
+<type> <seq> <value 0 lo> <value 0 hi> ... [<checksum>]
+every value is a 16 bit little endian integer (signed for MAG, YAW and ERR,
+unsigned for STAT, DROP and RX), the sequence number counts the frames of the type queued modulo 256
+and the checksum, if enabled, is the XOR of all the preceding bytes. The frame
+is COBS encoded and terminated by a 0 byte, so a receiver resynchronizes on
+the next 0 after any lost byte. See host/tools/telemetry_decode.c.
+*/
+#define FORMAT_FRAME_MAG 1 // x, y, z
+#define FORMAT_FRAME_YAW 2 // degrees
+#define FORMAT_FRAME_ERR 3 // error code
+#define FORMAT_FRAME_STAT 4 // the five values of a $STAT line
+#define FORMAT_FRAME_DROP 5 // one value per output lane
+#define FORMAT_FRAME_RX 6 // the losses of the receive path
+
+/*
+Writes the message $<type>,<values[0]>,...,<values[n_values - 1]>* straight
+into the lane, followed by the checksum if enabled, and starts the
+transmission. The length is computed first and the message is admitted by
+outq_reserve() as a whole; the write index is published once at the end, so
+the DMA engine never sees half a message.
+Returns 1 if the message was queued, 0 if it was dropped.
+In binary mode the message becomes a FORMAT_FRAME_* frame, types without a
+frame layout are dropped.
+*/
+int print_msg(struct OutLane *lane, const char *type, const long *values, int n_values);
+
+/*
+Enables the NMEA style checksum: two upper case hex digits after the '*' with
+the XOR of all the characters between '$' and '*', computed while the message
+is written.
+*/
+void format_set_checksum(int enabled);
+
+// FORMAT_TEXT or FORMAT_BINARY, the messages already queued are not affected
+void format_set_mode(int mode);
+int format_mode(void);
+
+#endif	/* FORMAT_H */
@@ -0,0 +1,95 @@
+#ifndef HAL_H
+#define	HAL_H
+
+// Thin hardware abstraction layer. On the dsPIC the firmware keeps talking to
+// the real SFRs from <xc.h>; when compiled for a Linux host the same register
+// names are provided by the simulated register file in host/xc_host.h, so the
+// main loop, the parser and the ring buffers build unchanged with gcc/clang.
+//
+// Only the accesses that have side effects on read or write (data registers)
+// and the busy-wait loops go through macros, everything else is a plain SFR.
+
+// instruction clock set up by the configuration bits, in Hz
+#define FCY 72000000UL
+
+#ifdef __XC16__
+
+#include <xc.h>
+
+#define HAL_ISR __attribute__((__interrupt__, no_auto_psv))
+
+// called inside every busy-wait loop, on the target we just spin
+#define HAL_SPIN()
+
+// stops the CPU until an enabled interrupt, the peripherals keep running
+#define HAL_IDLE() Idle()
+
+#define HAL_SPI1_WRITE(data) (SPI1BUF = (data))
+#define HAL_SPI1_READ() (SPI1BUF)
+
+#define HAL_U1_WRITE(data) (U1TXREG = (data))
+#define HAL_U1_READ() (U1RXREG)
+
+// DMA channel addresses are 16 bit data space addresses, the host backend
+// keeps the pointers instead
+#define HAL_DMA0_SOURCE(p) (DMA0STAL = (unsigned int)(p), DMA0STAH = 0)
+#define HAL_DMA0_PERIPHERAL(p) (DMA0PAD = (unsigned int)(p))
+
+// The dsPIC has a single in-order core and 16 bit loads and stores are atomic,
+// so publishing an index only needs the compiler not to move memory accesses
+// across it
+#define HAL_BARRIER() __asm__ volatile ("" ::: "memory")
+#define HAL_LOAD_ACQUIRE(p) ({ const unsigned int v_ = *(p); HAL_BARRIER(); v_; })
+#define HAL_STORE_RELEASE(p, v) do { HAL_BARRIER(); *(p) = (v); } while (0)
+
+// critical section against every interrupt, saving the CPU priority in an
+// int to restore it afterwards (so it nests and works inside an ISR)
+#define HAL_IRQ_DISABLE(saved) SET_AND_SAVE_CPU_IPL(saved, 7)
+#define HAL_IRQ_RESTORE(saved) RESTORE_CPU_IPL(saved)
+
+// timing instrumentation, only the host simulator records it
+#define HAL_TASK_BEGIN(name)
+#define HAL_TASK_END(name)
+#define HAL_DEADLINE(missed) ((void)(missed))
+#define HAL_CPU_CYCLES(cycles)
+
+#else
+
+#include "host/xc_host.h"
+
+#define HAL_ISR
+
+// lets the simulated peripherals advance up to their next event and runs the
+// pending interrupt service routines
+#define HAL_SPIN() hal_host_spin()
+#define HAL_IDLE() hal_host_idle()
+
+#define HAL_SPI1_WRITE(data) hal_host_spi1_write(data)
+#define HAL_SPI1_READ() hal_host_spi1_read()
+
+#define HAL_U1_WRITE(data) hal_host_u1_write(data)
+#define HAL_U1_READ() hal_host_u1_read()
+
+#define HAL_DMA0_SOURCE(p) hal_host_dma0_source(p)
+#define HAL_DMA0_PERIPHERAL(p) hal_host_dma0_peripheral(p)
+
+// on the host the two sides of a ring may run on different threads
+#define HAL_BARRIER() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#define HAL_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define HAL_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#define HAL_IRQ_DISABLE(saved) ((saved) = hal_host_irq_disable())
+#define HAL_IRQ_RESTORE(saved) hal_host_irq_restore(saved)
+
+// per-task cycle accounting for the budget report printed at the end of the
+// simulation. HAL_DEADLINE takes the return value of tmr_wait_period() on the
+// main loop timer, HAL_CPU_CYCLES charges the estimated cost of code that
+// does not busy-wait (the simulated clock does not advance on its own)
+#define HAL_TASK_BEGIN(name) hal_host_task_begin(name)
+#define HAL_TASK_END(name) hal_host_task_end(name)
+#define HAL_DEADLINE(missed) hal_host_deadline(missed)
+#define HAL_CPU_CYCLES(cycles) hal_host_cpu(cycles)
+
+#endif
+
+#endif	/* HAL_H */
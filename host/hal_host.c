@@ -0,0 +1,602 @@
+// Register-level host backend of the HAL (see hal.h).
+//
+// The simulated clock only advances while the firmware is busy-waiting
+// (HAL_SPIN), jumping straight to the next peripheral event: a timer period
+// match, the end of an SPI byte, the end of a UART character. Interrupts are
+// dispatched at the same points, so between two spins the firmware runs
+// atomically, exactly like a single core with no preemption in that window.
+//
+// UART1 TX goes to stdout, UART1 RX is fed from stdin (when it is not a
+// terminal) at the configured baud rate, DMA channel 0 can feed it on the
+// UART1 TX request, SPI1 talks to a model of the BMX055
+// magnetometer. The run stops after HAL_HOST_SECONDS simulated seconds
+// (default 10) and prints on stderr the interrupt rates and the per-task
+// timing budget collected by host/profile.c.
+//
+// Host build:
+//   cc -std=gnu99 -O2 -I. -o firmware_host *.c host/*.c -lm
+
+#include "xc_host.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define HOST_FCY 72000000ULL
+#define NO_EVENT UINT64_MAX
+
+#define UART_FIFO_LEN 4
+
+#define DMA_IRQ_U1TX 0x0C
+
+// registers
+
+volatile SPI1STATBITS SPI1STATbits;
+volatile SPI1CON1BITS SPI1CON1bits;
+volatile U1STABITS U1STAbits = {.TRMT = 1, .RIDLE = 1};
+volatile U1MODEBITS U1MODEbits;
+volatile uint16_t U1BRG;
+volatile uint16_t U1TXREG;
+volatile DMA0CONBITS DMA0CONbits;
+volatile DMA0REQBITS DMA0REQbits;
+volatile uint16_t DMA0CNT;
+volatile IFS0BITS IFS0bits;
+volatile IFS1BITS IFS1bits;
+volatile IEC0BITS IEC0bits;
+volatile IEC1BITS IEC1bits;
+volatile TxCONBITS T1CONbits, T2CONbits, T3CONbits, T4CONbits;
+volatile uint16_t TMR1, TMR2, TMR3, TMR4;
+volatile uint16_t PR1 = 0xFFFF, PR2 = 0xFFFF, PR3 = 0xFFFF, PR4 = 0xFFFF;
+volatile uint16_t TRISA = 0xFFFF, TRISG = 0xFFFF, LATA;
+volatile uint16_t ANSELA, ANSELB, ANSELC, ANSELD, ANSELE, ANSELG;
+volatile TRISABITS TRISAbits;
+volatile TRISBBITS TRISBbits;
+volatile TRISDBITS TRISDbits;
+volatile TRISFBITS TRISFbits;
+volatile LATGBITS LATGbits;
+volatile PORTBBITS PORTBbits;
+volatile RPINR18BITS RPINR18bits;
+volatile RPINR20BITS RPINR20bits;
+volatile RPOR0BITS RPOR0bits;
+volatile RPOR11BITS RPOR11bits;
+volatile RPOR12BITS RPOR12bits;
+
+static volatile PORTDBITS portd = {.RD6 = 1};
+static unsigned long portd_accesses;
+
+// the firmware only defines the service routines it uses
+
+__attribute__((weak)) void _T1Interrupt(void) {}
+__attribute__((weak)) void _DMA0Interrupt(void) {}
+__attribute__((weak)) void _T2Interrupt(void) {}
+__attribute__((weak)) void _T3Interrupt(void) {}
+__attribute__((weak)) void _T4Interrupt(void) {}
+__attribute__((weak)) void _SPI1Interrupt(void) {}
+__attribute__((weak)) void _U1RXInterrupt(void) {}
+__attribute__((weak)) void _U1TXInterrupt(void) {}
+
+static uint64_t now;
+static uint64_t idle_cycles;
+static uint64_t end_cycles;
+
+// TIMER1-4
+
+struct host_timer {
+    volatile TxCONBITS *con;
+    volatile uint16_t *tmr;
+    volatile uint16_t *pr;
+
+    uint64_t base; // cycle at which the counter was 0
+    uint16_t tmr_seen, pr_seen;
+    unsigned ton_seen, tckps_seen;
+};
+
+static struct host_timer timers[4] = {
+    {.con = &T1CONbits, .tmr = &TMR1, .pr = &PR1},
+    {.con = &T2CONbits, .tmr = &TMR2, .pr = &PR2},
+    {.con = &T3CONbits, .tmr = &TMR3, .pr = &PR3},
+    {.con = &T4CONbits, .tmr = &TMR4, .pr = &PR4},
+};
+
+static const unsigned timer_prescalers[] = {1, 8, 64, 256};
+
+static void timer_set_flag(int i) {
+    switch (i) {
+    case 0: IFS0bits.T1IF = 1; break;
+    case 1: IFS0bits.T2IF = 1; break;
+    case 2: IFS0bits.T3IF = 1; break;
+    case 3: IFS1bits.T4IF = 1; break;
+    }
+}
+
+static uint64_t timer_period_cycles(const struct host_timer *t) {
+    return ((uint64_t)*t->pr + 1) * timer_prescalers[t->con->TCKPS];
+}
+
+// brings the counter up to date, rebasing it when the firmware wrote TMRx,
+// PRx or TxCON since the last time we looked
+static void timer_sync(int i) {
+    struct host_timer *t = &timers[i];
+    const unsigned presc = timer_prescalers[t->con->TCKPS];
+
+    if (*t->tmr != t->tmr_seen || *t->pr != t->pr_seen
+            || t->con->TON != t->ton_seen || t->con->TCKPS != t->tckps_seen) {
+        t->base = now - (uint64_t)*t->tmr * presc;
+        t->pr_seen = *t->pr;
+        t->ton_seen = t->con->TON;
+        t->tckps_seen = t->con->TCKPS;
+    }
+
+    if (!t->con->TON) {
+        // a stopped timer holds its value
+        t->base = now - (uint64_t)*t->tmr * presc;
+        t->tmr_seen = *t->tmr;
+        return;
+    }
+
+    const uint64_t period = timer_period_cycles(t);
+    if (now - t->base >= period) {
+        t->base += (now - t->base) / period * period;
+        timer_set_flag(i);
+    }
+    *t->tmr = t->tmr_seen = (uint16_t)((now - t->base) / presc);
+}
+
+static uint64_t timer_next_event(int i) {
+    const struct host_timer *t = &timers[i];
+    return t->con->TON ? t->base + timer_period_cycles(t) : NO_EVENT;
+}
+
+// SPI1 with a BMX055 magnetometer on the CS_MAG line
+
+static uint64_t spi_done = NO_EVENT;
+static unsigned spi_tx_byte;
+static unsigned spi_rx_byte;
+static unsigned long spi_frame_accesses;
+
+static uint8_t mag_regs[0x80];
+static int mag_addr = -1; // -1 until the address byte of a frame is received
+static int mag_read;
+static uint64_t mag_next_sample;
+
+static const unsigned mag_odr_hz[] = {10, 2, 6, 8, 15, 20, 25, 30};
+
+static uint64_t spi_byte_cycles(void) {
+    static const unsigned primary[] = {64, 16, 4, 1};
+    const unsigned secondary = 8 - SPI1CON1bits.SPRE;
+    return 8ULL * primary[SPI1CON1bits.PPRE] * secondary;
+}
+
+static int mag_active(void) {
+    // power control bit set and operation mode normal
+    return (mag_regs[0x4B] & 0x01) && (mag_regs[0x4C] & 0x06) == 0;
+}
+
+// the field rotates in the horizontal plane at 10 deg/s
+static void mag_sample(void) {
+    const double t = (double)now / HOST_FCY;
+    const double heading = t * 10.0 * M_PI / 180.0;
+    const int x = (int)lround(2000.0 * cos(heading));
+    const int y = (int)lround(2000.0 * sin(heading));
+    const int z = -4000;
+
+    // 13 bit x/y left aligned on bits 15:3, 15 bit z on bits 15:1
+    const uint16_t rx = (uint16_t)((uint16_t)x << 3), ry = (uint16_t)((uint16_t)y << 3);
+    const uint16_t rz = (uint16_t)((uint16_t)z << 1);
+    mag_regs[0x42] = rx & 0xF8;
+    mag_regs[0x43] = rx >> 8;
+    mag_regs[0x44] = ry & 0xF8;
+    mag_regs[0x45] = ry >> 8;
+    mag_regs[0x46] = rz & 0xFE;
+    mag_regs[0x47] = rz >> 8;
+}
+
+static void mag_update(void) {
+    if (!mag_active()) {
+        mag_next_sample = NO_EVENT;
+        return;
+    }
+    if (mag_next_sample == NO_EVENT) {
+        mag_next_sample = now;
+    }
+    while (mag_next_sample <= now) {
+        mag_sample();
+        mag_next_sample += HOST_FCY / mag_odr_hz[(mag_regs[0x4C] >> 3) & 0x07];
+    }
+}
+
+static unsigned mag_transfer(unsigned mosi) {
+    if (portd.RD6) {
+        return 0xFF; // not selected, MISO floating
+    }
+    if (spi_frame_accesses != portd_accesses) {
+        // chip select toggled since the last byte: a new frame starts
+        spi_frame_accesses = portd_accesses;
+        mag_addr = -1;
+    }
+    if (mag_addr < 0) {
+        mag_addr = mosi & 0x7F;
+        mag_read = mosi & 0x80;
+        return 0xFF;
+    }
+
+    mag_update();
+    unsigned miso = 0xFF;
+    if (mag_read) {
+        miso = mag_regs[mag_addr];
+    } else {
+        mag_regs[mag_addr] = (uint8_t)mosi;
+        mag_update();
+    }
+    mag_addr = (mag_addr + 1) & 0x7F;
+    return miso;
+}
+
+volatile PORTDBITS *hal_host_portd(void) {
+    ++portd_accesses;
+    return &portd;
+}
+
+void hal_host_spi1_write(unsigned int data) {
+    if (!SPI1STATbits.SPIEN || spi_done != NO_EVENT) {
+        return; // only one byte in flight, the firmware waits for SPIRBF
+    }
+    spi_tx_byte = data & 0xFF;
+    spi_done = now + spi_byte_cycles();
+}
+
+unsigned int hal_host_spi1_read(void) {
+    SPI1STATbits.SPIRBF = 0;
+    return spi_rx_byte;
+}
+
+static void spi_update(void) {
+    if (spi_done > now) {
+        return;
+    }
+    spi_done = NO_EVENT;
+    const unsigned rx = mag_transfer(spi_tx_byte);
+    if (SPI1STATbits.SPIRBF) {
+        SPI1STATbits.SPIROV = 1; // previous byte never read, the new one is lost
+    } else {
+        spi_rx_byte = rx;
+        SPI1STATbits.SPIRBF = 1;
+    }
+    IFS0bits.SPI1IF = 1;
+}
+
+// DMA channel 0, one-shot RAM to peripheral byte transfers
+
+static const volatile uint8_t *dma_source;
+static volatile void *dma_peripheral;
+static unsigned dma_count, dma_pos;
+static int dma_armed;
+
+void hal_host_dma0_source(const volatile void *p) {
+    dma_source = p;
+}
+
+void hal_host_dma0_peripheral(volatile void *p) {
+    dma_peripheral = p;
+}
+
+static void dma_transfer(void) {
+    const uint8_t byte = dma_source[dma_pos++];
+    const int done = dma_pos == dma_count;
+    if (done) {
+        dma_pos = 0;
+        if (DMA0CONbits.MODE & 1) {
+            DMA0CONbits.CHEN = 0; // one-shot: the channel disables itself
+            dma_armed = 0;
+        }
+    }
+
+    // the write may raise the next request, the channel is already updated
+    if (DMA0CONbits.DIR && dma_peripheral == &U1TXREG) {
+        hal_host_u1_write(byte);
+    }
+    if (done) {
+        IFS0bits.DMA0IF = 1;
+    }
+}
+
+// latches the transfer count when the firmware enables the channel and
+// serves a forced request
+static void dma_sync(void) {
+    if (!DMA0CONbits.CHEN) {
+        dma_armed = 0;
+        DMA0REQbits.FORCE = 0;
+        return;
+    }
+    if (!dma_armed) {
+        dma_armed = 1;
+        dma_count = DMA0CNT + 1u;
+        dma_pos = 0;
+    }
+    if (DMA0REQbits.FORCE) {
+        DMA0REQbits.FORCE = 0;
+        dma_transfer();
+    }
+}
+
+// a peripheral interrupt event, it moves one byte if the channel listens to it
+static void dma_request(unsigned irq) {
+    dma_sync();
+    if (dma_armed && DMA0REQbits.IRQSEL == irq) {
+        dma_transfer();
+    }
+}
+
+// UART1
+
+static uint8_t tx_fifo[UART_FIFO_LEN];
+static int tx_count;
+static uint64_t tx_done = NO_EVENT; // end of the character in the shift register
+static uint8_t tx_shift;
+
+static uint8_t rx_fifo[UART_FIFO_LEN];
+static int rx_count;
+static uint64_t rx_next = NO_EVENT;
+
+static uint8_t *rx_stream;
+static size_t rx_stream_len;
+static size_t rx_stream_pos;
+
+static unsigned long uart_tx_bytes;
+
+static uint64_t uart_char_cycles(void) {
+    // start bit, 8 data bits, stop bit
+    return 10ULL * (U1MODEbits.BRGH ? 4 : 16) * ((uint64_t)U1BRG + 1);
+}
+
+static void uart_tx_load(void) {
+    tx_shift = tx_fifo[0];
+    for (int i = 1; i < tx_count; ++i) {
+        tx_fifo[i - 1] = tx_fifo[i];
+    }
+    --tx_count;
+    tx_done = now + uart_char_cycles();
+    U1STAbits.UTXBF = 0;
+    U1STAbits.TRMT = 0;
+
+    // UTXISEL = 0b10 interrupts when the buffer becomes empty, 0b00 on every
+    // character moved to the shift register
+    if (!U1STAbits.UTXISEL1 || tx_count == 0) {
+        IFS0bits.U1TXIF = 1;
+        dma_request(DMA_IRQ_U1TX);
+    }
+}
+
+void hal_host_u1_write(unsigned int data) {
+    if (!U1MODEbits.UARTEN || !U1STAbits.UTXEN || tx_count == UART_FIFO_LEN) {
+        return;
+    }
+    tx_fifo[tx_count++] = (uint8_t)data;
+    U1STAbits.UTXBF = tx_count == UART_FIFO_LEN;
+    if (tx_done == NO_EVENT) {
+        uart_tx_load();
+    }
+}
+
+unsigned int hal_host_u1_read(void) {
+    if (rx_count == 0) {
+        return 0;
+    }
+    const uint8_t c = rx_fifo[0];
+    for (int i = 1; i < rx_count; ++i) {
+        rx_fifo[i - 1] = rx_fifo[i];
+    }
+    U1STAbits.URXDA = --rx_count > 0;
+    return c;
+}
+
+static void uart_update(void) {
+    if (tx_done <= now) {
+        fputc(tx_shift, stdout);
+        ++uart_tx_bytes;
+        tx_done = NO_EVENT;
+        if (tx_count > 0) {
+            uart_tx_load();
+        } else {
+            U1STAbits.TRMT = 1;
+        }
+    }
+
+    if (!U1MODEbits.UARTEN || rx_stream_pos == rx_stream_len) {
+        rx_next = NO_EVENT;
+        U1STAbits.RIDLE = 1;
+        return;
+    }
+    // stdin is received back to back, a character is always in progress
+    U1STAbits.RIDLE = 0;
+    if (rx_next == NO_EVENT) {
+        rx_next = now + uart_char_cycles();
+    }
+    while (rx_next <= now && rx_stream_pos < rx_stream_len) {
+        const uint8_t c = rx_stream[rx_stream_pos++];
+        if (U1STAbits.OERR) {
+            // the receiver stays stopped until the overrun is cleared
+        } else if (rx_count == UART_FIFO_LEN) {
+            U1STAbits.OERR = 1;
+        } else {
+            rx_fifo[rx_count++] = c;
+            U1STAbits.URXDA = 1;
+            // URXISEL: 0x/ every char, 10/ 3 chars, 11/ 4 chars
+            if (U1STAbits.URXISEL < 2 || rx_count >= U1STAbits.URXISEL + 1) {
+                IFS0bits.U1RXIF = 1;
+            }
+        }
+        rx_next += uart_char_cycles();
+    }
+}
+
+// interrupts, in natural priority order
+
+enum { ISR_T1, ISR_DMA0, ISR_T2, ISR_T3, ISR_SPI1, ISR_U1RX, ISR_U1TX, ISR_T4, N_ISR };
+static const char *const isr_names[N_ISR] = {
+    "T1", "DMA0", "T2", "T3", "SPI1", "U1RX", "U1TX", "T4",
+};
+static unsigned long isr_count[N_ISR];
+
+static int irq_disabled;
+
+int hal_host_irq_disable(void) {
+    const int saved = irq_disabled;
+    irq_disabled = 1;
+    return saved;
+}
+
+static void dispatch_interrupts(void);
+
+void hal_host_irq_restore(int saved) {
+    irq_disabled = saved;
+    dispatch_interrupts(); // the pending ones are served right away
+}
+
+static void dispatch_interrupts(void) {
+    if (irq_disabled) {
+        return; // the flags stay set, served after the critical section
+    }
+    // the firmware runs with a single priority level, no nesting: a service
+    // routine that spins does not dispatch the others
+    irq_disabled = 1;
+
+    if (IEC0bits.T1IE && IFS0bits.T1IF) {
+        ++isr_count[ISR_T1];
+        _T1Interrupt();
+    }
+    if (IEC0bits.DMA0IE && IFS0bits.DMA0IF) {
+        ++isr_count[ISR_DMA0];
+        _DMA0Interrupt();
+    }
+    if (IEC0bits.T2IE && IFS0bits.T2IF) {
+        ++isr_count[ISR_T2];
+        _T2Interrupt();
+    }
+    if (IEC0bits.T3IE && IFS0bits.T3IF) {
+        ++isr_count[ISR_T3];
+        _T3Interrupt();
+    }
+    if (IEC0bits.SPI1IE && IFS0bits.SPI1IF) {
+        ++isr_count[ISR_SPI1];
+        _SPI1Interrupt();
+    }
+    if (IEC0bits.U1RXIE && IFS0bits.U1RXIF) {
+        ++isr_count[ISR_U1RX];
+        _U1RXInterrupt();
+    }
+    if (IEC0bits.U1TXIE && IFS0bits.U1TXIF) {
+        ++isr_count[ISR_U1TX];
+        _U1TXInterrupt();
+    }
+    if (IEC1bits.T4IE && IFS1bits.T4IF) {
+        ++isr_count[ISR_T4];
+        _T4Interrupt();
+    }
+
+    irq_disabled = 0;
+}
+
+static void update_peripherals(void) {
+    for (int i = 0; i < 4; ++i) {
+        timer_sync(i);
+    }
+    dma_sync();
+    spi_update();
+    uart_update();
+}
+
+static uint64_t next_event(void) {
+    uint64_t next = end_cycles;
+    for (int i = 0; i < 4; ++i) {
+        const uint64_t t = timer_next_event(i);
+        next = t < next ? t : next;
+    }
+    next = spi_done < next ? spi_done : next;
+    next = tx_done < next ? tx_done : next;
+    next = rx_next < next ? rx_next : next;
+    return next;
+}
+
+// moves the clock forward to min(limit, next event) and lets the peripherals
+// and the interrupts react to it
+static void advance(uint64_t limit) {
+    update_peripherals();
+
+    const uint64_t next = next_event();
+    const uint64_t target = next < limit ? next : limit;
+    now = target > now ? target : now + 1;
+    if (now >= end_cycles) {
+        exit(0);
+    }
+
+    update_peripherals();
+    dispatch_interrupts();
+}
+
+void hal_host_spin(void) {
+    advance(NO_EVENT);
+}
+
+void hal_host_idle(void) {
+    const uint64_t from = now;
+    advance(NO_EVENT);
+    idle_cycles += now - from;
+}
+
+void hal_host_cpu(unsigned long cycles) {
+    const uint64_t target = now + cycles;
+    while (now < target) {
+        advance(target);
+    }
+}
+
+uint64_t hal_host_t1_period(void) {
+    return T1CONbits.TON ? timer_period_cycles(&timers[0]) : 0;
+}
+
+uint64_t hal_host_cycles(void) {
+    return now;
+}
+
+static void report(void) {
+    fflush(stdout);
+    fprintf(stderr, "simulated %.3f s, %lu bytes sent on UART1\n",
+            (double)now / HOST_FCY, uart_tx_bytes);
+    fprintf(stderr, "interrupts per second:");
+    for (int i = 0; i < N_ISR; ++i) {
+        fprintf(stderr, " %s %.1f", isr_names[i], isr_count[i] * (double)HOST_FCY / now);
+    }
+    fputc('\n', stderr);
+    fprintf(stderr, "CPU idle %.1f%%\n", now ? 100.0 * idle_cycles / now : 0.0);
+    hal_host_profile_report();
+}
+
+static void load_rx_stream(void) {
+    if (isatty(STDIN_FILENO)) {
+        return;
+    }
+    size_t cap = 0;
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (rx_stream_len == cap) {
+            cap = cap ? cap * 2 : 256;
+            rx_stream = realloc(rx_stream, cap);
+            if (!rx_stream) {
+                perror("hal_host");
+                exit(1);
+            }
+        }
+        rx_stream[rx_stream_len++] = (uint8_t)c;
+    }
+}
+
+__attribute__((constructor)) static void hal_host_init(void) {
+    const char *seconds = getenv("HAL_HOST_SECONDS");
+    const double s = seconds ? atof(seconds) : 10.0;
+    end_cycles = (uint64_t)(s * HOST_FCY);
+
+    load_rx_stream();
+    atexit(report);
+}
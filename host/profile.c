@@ -0,0 +1,114 @@
+// Per-task timing budget of the simulated main loop.
+//
+// Every HAL_TASK_BEGIN/HAL_TASK_END pair records the simulated cycles spent in
+// between; at the end of the run the report lists, for each task, how many
+// times it ran and its average, percentile and worst cost, both in cycles and
+// as a share of the TIMER1 period. HAL_DEADLINE counts the periods in which
+// tmr_wait_period() found the flag already set, i.e. the loop overran.
+
+#include "xc_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TASKS 16
+
+struct task_profile {
+    const char *name;
+    uint64_t start;
+    int running;
+
+    uint32_t *samples;
+    size_t n, cap;
+};
+
+static struct task_profile tasks[MAX_TASKS];
+static int n_tasks;
+
+static unsigned long periods;
+static unsigned long missed_deadlines;
+
+static struct task_profile *find_task(const char *name) {
+    for (int i = 0; i < n_tasks; ++i) {
+        if (strcmp(tasks[i].name, name) == 0) {
+            return &tasks[i];
+        }
+    }
+    if (n_tasks == MAX_TASKS) {
+        fprintf(stderr, "profile: too many tasks, ignoring %s\n", name);
+        return NULL;
+    }
+    tasks[n_tasks].name = name;
+    return &tasks[n_tasks++];
+}
+
+void hal_host_task_begin(const char *name) {
+    struct task_profile *t = find_task(name);
+    if (t) {
+        t->start = hal_host_cycles();
+        t->running = 1;
+    }
+}
+
+void hal_host_task_end(const char *name) {
+    struct task_profile *t = find_task(name);
+    if (!t || !t->running) {
+        return;
+    }
+    t->running = 0;
+
+    if (t->n == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 1024;
+        t->samples = realloc(t->samples, t->cap * sizeof(*t->samples));
+        if (!t->samples) {
+            perror("profile");
+            exit(1);
+        }
+    }
+    t->samples[t->n++] = (uint32_t)(hal_host_cycles() - t->start);
+}
+
+void hal_host_deadline(int missed) {
+    ++periods;
+    if (missed) {
+        ++missed_deadlines;
+    }
+}
+
+static int cmp_samples(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const struct task_profile *t, unsigned p) {
+    return t->samples[(t->n - 1) * p / 100];
+}
+
+void hal_host_profile_report(void) {
+    const uint64_t budget = hal_host_t1_period();
+
+    fprintf(stderr, "\nmain loop period: %llu cycles, %lu periods, %lu missed deadlines\n",
+            (unsigned long long)budget, periods, missed_deadlines);
+    fprintf(stderr, "%-14s %8s %10s %10s %10s %10s %10s %8s\n",
+            "task", "runs", "avg", "p50", "p95", "p99", "worst", "worst%");
+
+    for (int i = 0; i < n_tasks; ++i) {
+        struct task_profile *t = &tasks[i];
+        if (t->n == 0) {
+            continue;
+        }
+        qsort(t->samples, t->n, sizeof(*t->samples), cmp_samples);
+
+        uint64_t sum = 0;
+        for (size_t j = 0; j < t->n; ++j) {
+            sum += t->samples[j];
+        }
+        const uint32_t worst = t->samples[t->n - 1];
+
+        fprintf(stderr, "%-14s %8zu %10llu %10u %10u %10u %10u %7.1f%%\n",
+                t->name, t->n, (unsigned long long)(sum / t->n),
+                percentile(t, 50), percentile(t, 95), percentile(t, 99), worst,
+                budget ? 100.0 * worst / budget : 0.0);
+    }
+}
@@ -0,0 +1,97 @@
+// Accuracy sweep and benchmark of atan2_cdeg() (see fixmath.h).
+//
+// Compares the integer atan2 with libm atan2 on every input in -4096 : 4095
+// and on a grid covering the whole 16 bit range, then times it against
+// atan2() from libm. Fails if the error goes past MAX_ERROR centidegrees.
+//
+//   cc -std=gnu99 -O2 -I. -o atan2_bench host/tools/atan2_bench.c fixmath.c -lm
+//   ./atan2_bench
+//
+// The timings are of the host, they only compare the two implementations.
+
+#include "fixmath.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#define MAX_ERROR 10 // centidegrees, the 0.1 degrees of fixmath.h
+#define GRID_STEP 61
+#define BENCH_ROUNDS 20
+
+static double max_error;
+static long worst_y, worst_x;
+static unsigned long checked;
+
+static void check(int y, int x) {
+    const double expected = atan2(y, x) * 18000.0 / M_PI;
+    double error = fabs(atan2_cdeg(y, x) - expected);
+    if (error > 18000.0) { // -18000 and 18000 are the same angle
+        error = 36000.0 - error;
+    }
+    if (error > max_error) {
+        max_error = error;
+        worst_y = y;
+        worst_x = x;
+    }
+    ++checked;
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void) {
+    for (int y = -4096; y < 4096; ++y) {
+        for (int x = -4096; x < 4096; ++x) {
+            check(y, x);
+        }
+    }
+    for (int y = -32768; y < 32768; y += GRID_STEP) {
+        for (int x = -32768; x < 32768; x += GRID_STEP) {
+            check(y, x);
+        }
+        check(y, 32767);
+        check(y, -32768);
+    }
+    printf("atan2_bench: %lu inputs, max error %.2f cdeg at (%ld, %ld)\n",
+            checked, max_error, worst_y, worst_x);
+
+    // the same inputs for both, the sums keep the calls from being optimized out
+    volatile long sink = 0;
+    double start = seconds();
+    for (int r = 0; r < BENCH_ROUNDS; ++r) {
+        long sum = 0;
+        for (int y = -2048; y < 2048; y += 3) {
+            for (int x = -2048; x < 2048; x += 3) {
+                sum += atan2_cdeg(y, x);
+            }
+        }
+        sink += sum;
+    }
+    const double fixed = seconds() - start;
+
+    start = seconds();
+    for (int r = 0; r < BENCH_ROUNDS; ++r) {
+        double sum = 0;
+        for (int y = -2048; y < 2048; y += 3) {
+            for (int x = -2048; x < 2048; x += 3) {
+                sum += atan2(y, x);
+            }
+        }
+        sink += (long)sum;
+    }
+    const double libm = seconds() - start;
+
+    const double calls = (double)BENCH_ROUNDS * 1366 * 1366;
+    printf("atan2_bench: atan2_cdeg %.2f ns/call, libm atan2 %.2f ns/call\n",
+            fixed / calls * 1e9, libm / calls * 1e9);
+
+    if (max_error > MAX_ERROR) {
+        fprintf(stderr, "atan2_bench: max error %.2f cdeg over %d\n", max_error, MAX_ERROR);
+        return 1;
+    }
+    return 0;
+}
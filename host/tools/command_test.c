@@ -0,0 +1,92 @@
+// Test of the command index (see cmd_init() in command.h).
+//
+// Builds the index of the commands of main.c and checks that it has a slot
+// for each of them, so every lookup is a single probe, that every command is
+// found and that no other type of up to 4 letters is. A table with two
+// commands in the same slot must be refused.
+//
+//   cc -std=gnu99 -O2 -I. -o command_test host/tools/command_test.c command.c
+//   ./command_test
+//
+// The list below follows the commands table of main.c, a command added there
+// goes here as well.
+
+#include "command.h"
+
+#include <stdio.h>
+
+static const char *const names[] = {"RATE", "STAT", "BAUD", "CSUM", "MODE"};
+#define N_NAMES (int)(sizeof(names) / sizeof(names[0]))
+
+static int handler(const long *fields, int n_fields) {
+    (void)fields;
+    (void)n_fields;
+    return 0;
+}
+
+static unsigned long key_of(const char *s) {
+    unsigned long key = 0;
+    for (int i = 0; s[i]; ++i) {
+        key |= (unsigned long)(s[i] - ' ') << (MSG_KEY_BITS * i);
+    }
+    return key;
+}
+
+static int errors;
+
+static void fail(const char *what, const char *name) {
+    fprintf(stderr, "command_test: %s %s\n", what, name);
+    ++errors;
+}
+
+// every type of 1 to 4 upper case letters that is not a command
+static void check_unknown(char *name, int len, int depth) {
+    if (depth == len) {
+        name[len] = '\0';
+        for (int i = 0; i < N_NAMES; ++i) {
+            if (key_of(names[i]) == key_of(name)) {
+                return;
+            }
+        }
+        if (cmd_find(key_of(name))) {
+            fail("found the unknown type", name);
+        }
+        return;
+    }
+    for (char c = 'A'; c <= 'Z'; ++c) {
+        name[depth] = c;
+        check_unknown(name, len, depth + 1);
+    }
+}
+
+int main(void) {
+    struct Command table[N_NAMES];
+    for (int i = 0; i < N_NAMES; ++i) {
+        table[i] = (struct Command){.key = key_of(names[i]), .handler = handler};
+    }
+
+    if (!cmd_init(table, N_NAMES)) {
+        fail("two commands share a slot, change CMD_HASH_MUL", "");
+    }
+    for (int i = 0; i < N_NAMES; ++i) {
+        if (cmd_find(table[i].key) != &table[i]) {
+            fail("cannot find", names[i]);
+        }
+    }
+    char name[5];
+    for (int len = 1; len <= 4; ++len) {
+        check_unknown(name, len, 0);
+    }
+
+    // the same type twice always shares the slot
+    const struct Command twice[] = {table[0], table[0]};
+    if (cmd_init(twice, 2)) {
+        fail("accepted a collision of", names[0]);
+    }
+    if (cmd_find(table[0].key)) {
+        fail("kept the index of a refused table, found", names[0]);
+    }
+
+    fprintf(stderr, "command_test: %d commands, %d errors\n", N_NAMES, errors);
+    return errors ? 1 : 0;
+}
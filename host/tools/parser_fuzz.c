@@ -0,0 +1,151 @@
+// Fuzz target of the command parser (see parse_byte() in parser.h).
+//
+// Feeds every input to a fresh parser, byte by byte, and aborts if a result
+// is not NEW_MESSAGE, NO_MESSAGE or one of the error codes, if index_type or
+// n_fields go past PARSER_MAX_TYPE or PARSER_MAX_FIELDS, or if a message
+// reported as new is not consistent (terminated type, key of the type).
+// The first byte of the input selects the checksum mode. With libFuzzer:
+//
+//   clang -std=gnu99 -g -O1 -fsanitize=fuzzer,address,undefined -I.
+//       -o parser_fuzz host/tools/parser_fuzz.c parser.c
+//   ./parser_fuzz
+//
+// Without it, -DPARSER_FUZZ_MAIN adds a driver that runs the files given as
+// arguments, or random inputs built from pieces of frames:
+//
+//   cc -std=gnu99 -g -O1 -fsanitize=address,undefined -DPARSER_FUZZ_MAIN -I.
+//       -o parser_fuzz host/tools/parser_fuzz.c parser.c
+//   ./parser_fuzz [-n inputs] [files...]
+
+#include "parser.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void fail(const char *what, size_t offset, int result) {
+    fprintf(stderr, "parser_fuzz: %s at byte %zu, result %d\n", what, offset, result);
+    abort();
+}
+
+static void check_message(const parser_state *ps, size_t offset) {
+    if (ps->index_type < 1 || ps->msg_type[ps->index_type] != '\0'
+            || strlen(ps->msg_type) != (size_t)ps->index_type) {
+        fail("unterminated message type", offset, NEW_MESSAGE);
+    }
+    unsigned long key = 0;
+    for (int i = 0; i < ps->index_type; ++i) {
+        key |= (unsigned long)(ps->msg_type[i] - ' ') << (MSG_KEY_BITS * i);
+    }
+    if (key != ps->type_key) {
+        fail("type key not matching the type", offset, NEW_MESSAGE);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    parser_state ps;
+    memset(&ps, 0, sizeof(ps));
+    ps.state = STATE_DOLLAR;
+    ps.checksum = size > 0 && (data[0] & 1);
+
+    for (size_t i = 0; i < size; ++i) {
+        const int result = parse_byte(&ps, (char)data[i]);
+
+        if (result > NEW_MESSAGE || result < TRUNCATED_FRAME) {
+            fail("unknown result", i, result);
+        }
+        if (ps.index_type < 0 || ps.index_type > PARSER_MAX_TYPE) {
+            fail("index_type out of range", i, result);
+        }
+        if (ps.n_fields < 0 || ps.n_fields > PARSER_MAX_FIELDS) {
+            fail("n_fields out of range", i, result);
+        }
+        // a frame that ends waits for the next '$', unless it is this one
+        if (result != NO_MESSAGE
+                && ps.state != (data[i] == '$' ? STATE_TYPE : STATE_DOLLAR)) {
+            fail("frame ended in the wrong state", i, result);
+        }
+        if (result == NEW_MESSAGE) {
+            check_message(&ps, i);
+        }
+    }
+    return 0;
+}
+
+#ifdef PARSER_FUZZ_MAIN
+
+#define DEFAULT_INPUTS 1000000L
+#define MAX_INPUT 96
+
+// pieces of frames, so that the random inputs reach every state
+static const char *const tokens[] = {
+    "$", "$", "*", ",", ",", "-", "+", "RATE", "STAT", "CSUM", "TOOLONG",
+    "0", "7", "42", "-4000", "2147483647", "2147483648", "-2147483648",
+    "99999999999", ",1,2,3,4", "5D", "a0",
+};
+#define N_TOKENS (sizeof(tokens) / sizeof(tokens[0]))
+
+static unsigned long random_state = 1;
+
+static unsigned int next_random(void) {
+    random_state = random_state * 6364136223846793005UL + 1442695040888963407UL;
+    return (unsigned int)(random_state >> 33);
+}
+
+// one in eight pieces is a random byte
+static size_t random_input(uint8_t *buf) {
+    const size_t max = next_random() % MAX_INPUT;
+    size_t len = 0;
+    while (len < max) {
+        const unsigned int r = next_random();
+        if (r % 8 == 0) {
+            buf[len++] = (uint8_t)(r >> 8);
+            continue;
+        }
+        const char *t = tokens[(r >> 3) % N_TOKENS];
+        while (*t && len < max) {
+            buf[len++] = (uint8_t)*t++;
+        }
+    }
+    return len;
+}
+
+static int run_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "parser_fuzz: cannot open %s\n", path);
+        return 1;
+    }
+    static uint8_t buf[1 << 16];
+    const size_t n = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    LLVMFuzzerTestOneInput(buf, n);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long inputs = DEFAULT_INPUTS;
+    int arg = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        inputs = strtol(argv[2], NULL, 0);
+        arg = 3;
+    }
+    if (arg < argc) {
+        int errors = 0;
+        for (; arg < argc; ++arg) {
+            errors += run_file(argv[arg]);
+        }
+        return errors ? 1 : 0;
+    }
+
+    uint8_t buf[MAX_INPUT];
+    for (long n = 0; n < inputs; ++n) {
+        LLVMFuzzerTestOneInput(buf, random_input(buf));
+    }
+    fprintf(stderr, "parser_fuzz: %ld inputs\n", inputs);
+    return 0;
+}
+
+#endif
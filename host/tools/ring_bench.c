@@ -0,0 +1,128 @@
+// Microbenchmark of the byte ring (see ring.h).
+//
+// Queues a $MAG message and drains it, over and over, with the modulo
+// circular buffer the ring replaced, with ring_put()/ring_get(), with the
+// bulk ring_write()/ring_read() and with the zero-copy ring_stage()/
+// ring_commit() and ring_span()/ring_consume() the firmware uses, and prints
+// the time per byte of each. The bytes drained are checked against the
+// message.
+//
+//   cc -std=gnu99 -O2 -I. -o ring_bench host/tools/ring_bench.c ring.c
+//   ./ring_bench
+//
+// The timings are of the host, they only compare the implementations.
+
+#include "ring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 2000000
+
+static const char message[] = "$MAG,-1234,567,-4000*";
+#define MESSAGE_LEN (sizeof(message) - 1)
+
+// the buffer of the original firmware, with the length it had
+struct circular_buffer {
+    char *buff;
+    int read;
+    int write;
+
+    int len;
+};
+
+static char modulo_storage[48];
+static struct circular_buffer modulo_buff = {
+    .buff = modulo_storage,
+    .len = sizeof(modulo_storage),
+};
+
+RING_DEFINE(bench_ring, 64);
+
+static char drained[MESSAGE_LEN];
+static int errors;
+
+static void check(const char *name) {
+    if (memcmp(drained, message, MESSAGE_LEN) != 0) {
+        fprintf(stderr, "ring_bench: %s drained a different message\n", name);
+        ++errors;
+    }
+}
+
+static void modulo_round(void) {
+    struct circular_buffer *b = &modulo_buff;
+    for (unsigned int i = 0; i < MESSAGE_LEN; ++i) {
+        const int new_write_index = (b->write + 1) % b->len;
+        if (new_write_index == b->read) {
+            break;
+        }
+        b->buff[b->write] = message[i];
+        b->write = new_write_index;
+    }
+    unsigned int n = 0;
+    while (b->read != b->write) {
+        drained[n++] = b->buff[b->read];
+        b->read = (b->read + 1) % b->len;
+    }
+}
+
+static void put_get_round(void) {
+    for (unsigned int i = 0; i < MESSAGE_LEN; ++i) {
+        if (!ring_put(&bench_ring, message[i])) {
+            break;
+        }
+    }
+    unsigned int n = 0;
+    while (ring_get(&bench_ring, &drained[n])) {
+        ++n;
+    }
+}
+
+static void bulk_round(void) {
+    ring_write(&bench_ring, message, MESSAGE_LEN);
+    ring_read(&bench_ring, drained, MESSAGE_LEN);
+}
+
+static void zero_copy_round(void) {
+    if (ring_free(&bench_ring) >= MESSAGE_LEN) {
+        for (unsigned int i = 0; i < MESSAGE_LEN; ++i) {
+            ring_stage(&bench_ring, i, message[i]);
+        }
+        ring_commit(&bench_ring, MESSAGE_LEN);
+    }
+    const char *span;
+    unsigned int n = 0, len;
+    while ((len = ring_span(&bench_ring, &span)) > 0) {
+        memcpy(&drained[n], span, len);
+        ring_consume(&bench_ring, len);
+        n += len;
+    }
+}
+
+static double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run(const char *name, void (*round)(void)) {
+    const double start = seconds();
+    for (long i = 0; i < ROUNDS; ++i) {
+        round();
+        // the buffer is read back so the rounds cannot be merged
+        __asm__ volatile ("" ::: "memory");
+    }
+    const double elapsed = seconds() - start;
+    check(name);
+    printf("ring_bench: %-10s %.2f ns/byte\n", name,
+            elapsed / ROUNDS / MESSAGE_LEN * 1e9);
+}
+
+int main(void) {
+    run("modulo", modulo_round);
+    run("put/get", put_get_round);
+    run("bulk", bulk_round);
+    run("zero-copy", zero_copy_round);
+    return errors ? 1 : 0;
+}
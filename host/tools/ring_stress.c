@@ -0,0 +1,160 @@
+// Threaded stress test of the byte ring (see the contract in ring.h).
+//
+// A producer thread and a consumer thread share a small ring, the way the
+// main loop and the UART interrupts do on the target. The producer writes a
+// running sequence number, one byte at a time with ring_put() or in bursts
+// with ring_write() or ring_stage()/ring_commit(); the consumer reads it back
+// with ring_get(), ring_read() or ring_span()/ring_consume() and checks every
+// byte, so a slot read before it is published or reused before it is
+// released shows up as a gap in the sequence. Each side yields when it
+// cannot make progress.
+//
+//   cc -std=gnu99 -O2 -pthread -I. -o ring_stress host/tools/ring_stress.c ring.c
+//   ./ring_stress [bytes]
+//
+// Building with -fsanitize=thread checks the ordering of the indices too.
+
+#include "ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_BYTES 20000000UL
+#define MAX_BURST 13 // not a divisor of the capacity, so the bursts wrap
+
+RING_DEFINE(stress_ring, 16);
+
+static unsigned long total_bytes;
+static unsigned long errors;
+
+// xorshift, each thread has its own state
+static unsigned int next_random(unsigned int *state) {
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void *producer(void *arg) {
+    unsigned int random = 0x12345678;
+    unsigned char seq = 0;
+    unsigned long sent = 0;
+    (void)arg;
+
+    while (sent < total_bytes) {
+        const unsigned int r = next_random(&random);
+        if (r & 1) {
+            if (!ring_put(&stress_ring, (char)seq)) {
+                sched_yield();
+                continue;
+            }
+            ++seq;
+            ++sent;
+            continue;
+        }
+
+        unsigned int n = 1 + (r >> 2) % MAX_BURST;
+        if (n > total_bytes - sent) {
+            n = total_bytes - sent;
+        }
+        if (r & 2) {
+            char burst[MAX_BURST];
+            for (unsigned int i = 0; i < n; ++i) {
+                burst[i] = (char)(seq + i);
+            }
+            n = ring_write(&stress_ring, burst, n); // as many as fit
+            if (n == 0) {
+                sched_yield();
+                continue;
+            }
+            seq += n;
+            sent += n;
+            continue;
+        }
+
+        if (ring_free(&stress_ring) < n) {
+            sched_yield();
+            continue;
+        }
+        for (unsigned int i = 0; i < n; ++i) {
+            ring_stage(&stress_ring, i, (char)seq++);
+        }
+        ring_commit(&stress_ring, n);
+        sent += n;
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    unsigned int random = 0x9abcdef0;
+    unsigned char expected = 0;
+    unsigned long received = 0;
+    (void)arg;
+
+    while (received < total_bytes) {
+        const unsigned int r = next_random(&random);
+        if (r & 1) {
+            char c;
+            if (!ring_get(&stress_ring, &c)) {
+                sched_yield();
+                continue;
+            }
+            if ((unsigned char)c != expected && errors++ < 10) {
+                fprintf(stderr, "ring_stress: byte %lu is %d, expected %d\n",
+                        received, (unsigned char)c, expected);
+            }
+            expected = (unsigned char)c + 1; // resynchronize after a gap
+            ++received;
+            continue;
+        }
+
+        char burst[MAX_BURST];
+        const char *span = burst;
+        unsigned int n;
+        if (r & 2) {
+            n = ring_read(&stress_ring, burst, 1 + (r >> 2) % MAX_BURST);
+        } else {
+            n = ring_span(&stress_ring, &span);
+        }
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        for (unsigned int i = 0; i < n; ++i) {
+            const unsigned char c = (unsigned char)span[i];
+            if (c != expected && errors++ < 10) {
+                fprintf(stderr, "ring_stress: byte %lu is %d, expected %d\n",
+                        received + i, c, expected);
+            }
+            expected = c + 1;
+        }
+        if (span != burst) {
+            ring_consume(&stress_ring, n);
+        }
+        received += n;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    total_bytes = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_BYTES;
+
+    pthread_t producer_thread, consumer_thread;
+    if (pthread_create(&consumer_thread, NULL, consumer, NULL) != 0
+            || pthread_create(&producer_thread, NULL, producer, NULL) != 0) {
+        fprintf(stderr, "ring_stress: cannot start the threads\n");
+        return 2;
+    }
+    pthread_join(producer_thread, NULL);
+    pthread_join(consumer_thread, NULL);
+
+    if (ring_used(&stress_ring) != 0) {
+        fprintf(stderr, "ring_stress: %u bytes left in the ring\n", ring_used(&stress_ring));
+        ++errors;
+    }
+    fprintf(stderr, "ring_stress: %lu bytes, %lu errors\n", total_bytes, errors);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+// Simulator test of the queued SPI engine (see spi_submit() in spi.h).
+//
+// Transactions are submitted from the main context, from a software timer
+// callback (TIMER3 interrupt) and from the done callback of other
+// transactions (SPI1 interrupt), interleaved by the simulated clock. Every
+// submission is logged, and the transactions must complete once each, in
+// the order they were submitted. Submitting a transaction still queued must
+// be refused.
+//
+//   cc -std=gnu99 -O2 -I. -o spi_order_test host/tools/spi_order_test.c
+//       spi.c swtimer.c timer.c host/hal_host.c host/profile.c -lm
+//   ./spi_order_test < /dev/null
+//
+// The simulator dispatches the interrupts only where the firmware spins, so
+// an interrupt lands between two submissions but never inside spi_submit().
+
+#include "spi.h"
+#include "swtimer.h"
+#include "hal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define N_TRANSACTIONS 400
+#define MIN_LEN 20 // bytes, 16 cycles each at the SPI1 clock
+#define MAX_LEN 1000
+#define MAX_QUEUED 4 // from main, so the interrupts get their turn
+
+static struct SpiTransaction pool[N_TRANSACTIONS];
+static int n_used;
+
+static struct SpiTransaction *submitted[N_TRANSACTIONS];
+static int n_submitted;
+static struct SpiTransaction *completed[N_TRANSACTIONS];
+static int n_completed;
+
+static int from_main, from_timer, from_spi;
+static int errors, finished;
+static unsigned int random_state = 12345;
+
+static unsigned int next_random(void) {
+    random_state = random_state * 1103515245u + 12345u;
+    return random_state >> 16;
+}
+
+static void transaction_done(struct SpiTransaction *t);
+
+// the interrupts do not nest and main runs atomically between two spins,
+// so the log follows the order of the calls to spi_submit()
+static int submit_new(int *counter) {
+    if (n_used == N_TRANSACTIONS) {
+        return 0;
+    }
+    struct SpiTransaction *t = &pool[n_used++];
+    t->device = SPI_ACC;
+    t->tx = NULL;
+    t->rx = NULL;
+    t->len = MIN_LEN + (int)(next_random() % (MAX_LEN - MIN_LEN));
+    t->done = transaction_done;
+    if (!spi_submit(t)) {
+        fprintf(stderr, "spi_order_test: transaction %d refused\n", n_used - 1);
+        ++errors;
+        return 0;
+    }
+    submitted[n_submitted++] = t;
+    ++*counter;
+    return 1;
+}
+
+static void transaction_done(struct SpiTransaction *t) {
+    if (n_completed == N_TRANSACTIONS) {
+        ++errors;
+        return;
+    }
+    completed[n_completed++] = t;
+    // a submission from the SPI interrupt, right after the queue moved on
+    if (next_random() % 4 == 0) {
+        submit_new(&from_spi);
+    }
+}
+
+static void timer_submit(struct SwTimer *timer) {
+    if (!submit_new(&from_timer)) {
+        swtimer_stop(timer);
+    }
+}
+
+static struct SwTimer submit_timer = {.callback = timer_submit, .period = 1};
+
+// the simulation stops at HAL_HOST_SECONDS, which must not look like a pass
+static void check_finished(void) {
+    if (!finished) {
+        fprintf(stderr, "spi_order_test: simulated time over with %d of %d completed\n",
+                n_completed, n_submitted);
+        _exit(1);
+    }
+}
+
+int main(void) {
+    atexit(check_finished);
+    init_spi();
+    swtimer_init();
+    swtimer_start(&submit_timer, 1);
+
+    while (n_used < N_TRANSACTIONS) {
+        // bursts from main, then a random number of simulator events
+        for (unsigned int n = next_random() % 4;
+                n > 0 && n_submitted - n_completed < MAX_QUEUED; --n) {
+            struct SpiTransaction *queued = n_submitted > n_completed
+                ? submitted[n_submitted - 1] : NULL;
+            if (queued && spi_submit(queued)) {
+                fprintf(stderr, "spi_order_test: queued transaction accepted again\n");
+                ++errors;
+            }
+            submit_new(&from_main);
+        }
+        for (unsigned int n = next_random() % 64; n > 0; --n) {
+            HAL_SPIN();
+        }
+    }
+    swtimer_stop(&submit_timer);
+    while (spi_busy()) {
+        HAL_SPIN();
+    }
+
+    if (n_completed != n_submitted) {
+        fprintf(stderr, "spi_order_test: %d submitted, %d completed\n", n_submitted, n_completed);
+        ++errors;
+    }
+    for (int i = 0; i < n_completed && i < n_submitted; ++i) {
+        if (completed[i] != submitted[i]) {
+            fprintf(stderr, "spi_order_test: completion %d is transaction %d, submitted as %d\n",
+                    i, (int)(completed[i] - pool), (int)(submitted[i] - pool));
+            ++errors;
+            break;
+        }
+        if (!completed[i]->completed) {
+            fprintf(stderr, "spi_order_test: transaction %d not marked completed\n",
+                    (int)(completed[i] - pool));
+            ++errors;
+        }
+    }
+
+    finished = 1;
+    fprintf(stderr, "spi_order_test: %d transactions (%d main, %d timer, %d SPI), %d errors\n",
+            n_submitted, from_main, from_timer, from_spi, errors);
+    exit(errors ? 1 : 0);
+}
@@ -0,0 +1,147 @@
+// Decoder of the binary telemetry (see FORMAT_BINARY in format.h).
+//
+// Reads the UART output on stdin and prints every frame as the text message
+// the firmware would have sent, one per line, so the two modes can be
+// compared. Bytes before the first delimiter (the text output before the
+// $MODE,1* command) are skipped, corrupted frames and gaps in the sequence
+// numbers of each type are reported on stderr.
+//
+//   cc -std=gnu99 -O2 -I. -o telemetry_decode host/tools/telemetry_decode.c
+//   printf '$MODE,1*' | HAL_HOST_SECONDS=5 ./firmware_host | ./telemetry_decode
+//
+// With -c the frames are expected to end with the checksum ($CSUM,1*).
+
+#include "format.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_FRAME 256
+
+static const char *type_names[] = {
+    [FORMAT_FRAME_MAG] = "MAG",
+    [FORMAT_FRAME_YAW] = "YAW",
+    [FORMAT_FRAME_ERR] = "ERR",
+    [FORMAT_FRAME_STAT] = "STAT",
+    [FORMAT_FRAME_DROP] = "DROP",
+    [FORMAT_FRAME_RX] = "RX",
+};
+
+static const int type_values[] = {
+    [FORMAT_FRAME_MAG] = 3,
+    [FORMAT_FRAME_YAW] = 1,
+    [FORMAT_FRAME_ERR] = 1,
+    [FORMAT_FRAME_STAT] = 5,
+    [FORMAT_FRAME_DROP] = N_LANES,
+    [FORMAT_FRAME_RX] = 5,
+};
+
+#define N_TYPES (int)(sizeof(type_names) / sizeof(type_names[0]))
+
+static unsigned long frames, bad_frames, lost_frames;
+
+// decodes in place, returns the decoded length or -1 if the codes do not
+// match the frame length
+static int cobs_decode(unsigned char *buf, int len) {
+    int in = 0, out = 0;
+    while (in < len) {
+        const int code = buf[in++];
+        if (code == 0 || in + code - 1 > len) {
+            return -1;
+        }
+        for (int i = 1; i < code; ++i) {
+            buf[out++] = buf[in++];
+        }
+        if (code != 0xFF && in < len) {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+static void print_frame(const unsigned char *f, int len, int checksum) {
+    static int seen[N_TYPES];
+    static int last_seq[N_TYPES];
+
+    if (checksum) {
+        unsigned char sum = 0;
+        for (int i = 0; i < len; ++i) {
+            sum ^= f[i];
+        }
+        if (len < 1 || sum != 0) {
+            fprintf(stderr, "telemetry_decode: bad checksum\n");
+            ++bad_frames;
+            return;
+        }
+        --len;
+    }
+
+    const int type = len >= 2 ? f[0] : 0;
+    if (type <= 0 || type >= N_TYPES || !type_names[type]
+            || len != 2 + 2 * type_values[type]) {
+        fprintf(stderr, "telemetry_decode: bad frame, %d bytes\n", len);
+        ++bad_frames;
+        return;
+    }
+
+    const int seq = f[1];
+    if (seen[type] && seq != ((last_seq[type] + 1) & 0xFF)) {
+        const int lost = (seq - last_seq[type] - 1) & 0xFF;
+        fprintf(stderr, "telemetry_decode: %d %s frames lost before seq %d\n",
+                lost, type_names[type], seq);
+        lost_frames += lost;
+    }
+    seen[type] = 1;
+    last_seq[type] = seq;
+    ++frames;
+
+    printf("$%s", type_names[type]);
+    for (int i = 0; i < type_values[type]; ++i) {
+        const unsigned v = f[2 + 2 * i] | f[3 + 2 * i] << 8;
+        if (type >= FORMAT_FRAME_STAT) { // the counters
+            printf(",%u", v);
+        } else {
+            printf(",%d", (int16_t)v);
+        }
+    }
+    printf("*\n");
+}
+
+int main(int argc, char **argv) {
+    const int checksum = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+    unsigned char frame[MAX_FRAME];
+    int len = 0, synced = 0, overflow = 0;
+    unsigned long skipped = 0;
+    int c;
+
+    while ((c = getchar()) != EOF) {
+        if (c != 0) {
+            if (!synced) {
+                ++skipped;
+            } else if (len == MAX_FRAME) {
+                overflow = 1;
+            } else {
+                frame[len++] = (unsigned char)c;
+            }
+            continue;
+        }
+
+        if (synced && len > 0) {
+            const int n = overflow ? -1 : cobs_decode(frame, len);
+            if (n < 0) {
+                fprintf(stderr, "telemetry_decode: bad COBS frame, %d bytes\n", len);
+                ++bad_frames;
+            } else {
+                print_frame(frame, n, checksum);
+            }
+        }
+        synced = 1;
+        len = 0;
+        overflow = 0;
+    }
+
+    fprintf(stderr, "telemetry_decode: %lu frames, %lu bad, %lu lost, %lu bytes skipped\n",
+            frames, bad_frames, lost_frames, skipped);
+    return bad_frames ? 1 : 0;
+}
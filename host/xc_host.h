@@ -0,0 +1,286 @@
+#ifndef XC_HOST_H
+#define	XC_HOST_H
+
+// Simulated dsPIC33EP512MU810 register file for host builds. Only the SFRs
+// and bits used by the firmware are modelled; the bit layouts follow the
+// device datasheet so that the firmware code is the same on both targets.
+
+#include <stdint.h>
+
+typedef struct {
+    unsigned SPIRBF:1;
+    unsigned SPITBF:1;
+    unsigned SISEL:3;
+    unsigned SR1MPT:1;
+    unsigned SPIROV:1;
+    unsigned SRMPT:1;
+    unsigned SPIBEC:3;
+    unsigned :2;
+    unsigned SPISIDL:1;
+    unsigned :1;
+    unsigned SPIEN:1;
+} SPI1STATBITS;
+extern volatile SPI1STATBITS SPI1STATbits;
+
+typedef struct {
+    unsigned PPRE:2;
+    unsigned SPRE:3;
+    unsigned MSTEN:1;
+    unsigned CKP:1;
+    unsigned SSEN:1;
+    unsigned CKE:1;
+    unsigned SMP:1;
+    unsigned MODE16:1;
+    unsigned DISSDO:1;
+    unsigned DISSCK:1;
+    unsigned :3;
+} SPI1CON1BITS;
+extern volatile SPI1CON1BITS SPI1CON1bits;
+
+typedef struct {
+    unsigned URXDA:1;
+    unsigned OERR:1;
+    unsigned FERR:1;
+    unsigned PERR:1;
+    unsigned RIDLE:1;
+    unsigned ADDEN:1;
+    unsigned URXISEL:2;
+    unsigned TRMT:1;
+    unsigned UTXBF:1;
+    unsigned UTXEN:1;
+    unsigned UTXBRK:1;
+    unsigned :1;
+    unsigned UTXISEL0:1;
+    unsigned UTXINV:1;
+    unsigned UTXISEL1:1;
+} U1STABITS;
+extern volatile U1STABITS U1STAbits;
+
+typedef struct {
+    unsigned STSEL:1;
+    unsigned PDSEL:2;
+    unsigned BRGH:1;
+    unsigned URXINV:1;
+    unsigned ABAUD:1;
+    unsigned LPBACK:1;
+    unsigned WAKE:1;
+    unsigned UEN:2;
+    unsigned :1;
+    unsigned RTSMD:1;
+    unsigned IREN:1;
+    unsigned USIDL:1;
+    unsigned :1;
+    unsigned UARTEN:1;
+} U1MODEBITS;
+extern volatile U1MODEBITS U1MODEbits;
+
+extern volatile uint16_t U1BRG;
+
+// only its address is used, as the peripheral of a DMA channel
+extern volatile uint16_t U1TXREG;
+
+typedef struct {
+    unsigned INT0IF:1;
+    unsigned IC1IF:1;
+    unsigned OC1IF:1;
+    unsigned T1IF:1;
+    unsigned DMA0IF:1;
+    unsigned IC2IF:1;
+    unsigned OC2IF:1;
+    unsigned T2IF:1;
+    unsigned T3IF:1;
+    unsigned SPI1EIF:1;
+    unsigned SPI1IF:1;
+    unsigned U1RXIF:1;
+    unsigned U1TXIF:1;
+    unsigned AD1IF:1;
+    unsigned DMA1IF:1;
+    unsigned NVMIF:1;
+} IFS0BITS;
+extern volatile IFS0BITS IFS0bits;
+
+typedef struct {
+    unsigned SI2C1IF:1;
+    unsigned MI2C1IF:1;
+    unsigned CMIF:1;
+    unsigned CNIF:1;
+    unsigned INT1IF:1;
+    unsigned AD2IF:1;
+    unsigned IC7IF:1;
+    unsigned IC8IF:1;
+    unsigned DMA2IF:1;
+    unsigned OC3IF:1;
+    unsigned OC4IF:1;
+    unsigned T4IF:1;
+    unsigned T5IF:1;
+    unsigned INT2IF:1;
+    unsigned U2RXIF:1;
+    unsigned U2TXIF:1;
+} IFS1BITS;
+extern volatile IFS1BITS IFS1bits;
+
+typedef struct {
+    unsigned INT0IE:1;
+    unsigned IC1IE:1;
+    unsigned OC1IE:1;
+    unsigned T1IE:1;
+    unsigned DMA0IE:1;
+    unsigned IC2IE:1;
+    unsigned OC2IE:1;
+    unsigned T2IE:1;
+    unsigned T3IE:1;
+    unsigned SPI1EIE:1;
+    unsigned SPI1IE:1;
+    unsigned U1RXIE:1;
+    unsigned U1TXIE:1;
+    unsigned AD1IE:1;
+    unsigned DMA1IE:1;
+    unsigned NVMIE:1;
+} IEC0BITS;
+extern volatile IEC0BITS IEC0bits;
+
+typedef struct {
+    unsigned SI2C1IE:1;
+    unsigned MI2C1IE:1;
+    unsigned CMIE:1;
+    unsigned CNIE:1;
+    unsigned INT1IE:1;
+    unsigned AD2IE:1;
+    unsigned IC7IE:1;
+    unsigned IC8IE:1;
+    unsigned DMA2IE:1;
+    unsigned OC3IE:1;
+    unsigned OC4IE:1;
+    unsigned T4IE:1;
+    unsigned T5IE:1;
+    unsigned INT2IE:1;
+    unsigned U2RXIE:1;
+    unsigned U2TXIE:1;
+} IEC1BITS;
+extern volatile IEC1BITS IEC1bits;
+
+// DMA channel 0
+typedef struct {
+    unsigned MODE:2;
+    unsigned :2;
+    unsigned AMODE:2;
+    unsigned :5;
+    unsigned NULLW:1;
+    unsigned HALF:1;
+    unsigned DIR:1;
+    unsigned SIZE:1;
+    unsigned CHEN:1;
+} DMA0CONBITS;
+extern volatile DMA0CONBITS DMA0CONbits;
+
+typedef struct {
+    unsigned IRQSEL:8;
+    unsigned :7;
+    unsigned FORCE:1;
+} DMA0REQBITS;
+extern volatile DMA0REQBITS DMA0REQbits;
+
+extern volatile uint16_t DMA0CNT;
+
+// TxCON share the same layout for the bits we use
+typedef struct {
+    unsigned :1;
+    unsigned TCS:1;
+    unsigned TSYNC:1;
+    unsigned T32:1;
+    unsigned TCKPS:2;
+    unsigned TGATE:1;
+    unsigned :6;
+    unsigned TSIDL:1;
+    unsigned :1;
+    unsigned TON:1;
+} TxCONBITS;
+extern volatile TxCONBITS T1CONbits, T2CONbits, T3CONbits, T4CONbits;
+
+extern volatile uint16_t TMR1, TMR2, TMR3, TMR4;
+extern volatile uint16_t PR1, PR2, PR3, PR4;
+
+// GPIO, only the pins driven by the firmware have named bits
+extern volatile uint16_t TRISA, TRISG, LATA;
+extern volatile uint16_t ANSELA, ANSELB, ANSELC, ANSELD, ANSELE, ANSELG;
+
+typedef struct { unsigned :1; unsigned TRISA1:1; unsigned :14; } TRISABITS;
+typedef struct { unsigned :3; unsigned TRISB3:1; unsigned TRISB4:1; unsigned :11; } TRISBBITS;
+typedef struct { unsigned :6; unsigned TRISD6:1; unsigned :9; } TRISDBITS;
+typedef struct { unsigned :12; unsigned TRISF12:1; unsigned TRISF13:1; unsigned :2; } TRISFBITS;
+typedef struct { unsigned :9; unsigned LATG9:1; unsigned :6; } LATGBITS;
+typedef struct { unsigned :3; unsigned RB3:1; unsigned RB4:1; unsigned :11; } PORTBBITS;
+typedef struct { unsigned :6; unsigned RD6:1; unsigned :9; } PORTDBITS;
+extern volatile TRISABITS TRISAbits;
+extern volatile TRISBBITS TRISBbits;
+extern volatile TRISDBITS TRISDbits;
+extern volatile TRISFBITS TRISFbits;
+extern volatile LATGBITS LATGbits;
+extern volatile PORTBBITS PORTBbits;
+
+// the magnetometer chip select has to be observed by the SPI slave model to
+// find the frame boundaries, every access goes through the backend
+extern volatile PORTDBITS *hal_host_portd(void);
+#define PORTDbits (*hal_host_portd())
+
+// peripheral pin select, only stored
+typedef struct { unsigned U1RXR:7; unsigned :9; } RPINR18BITS;
+typedef struct { unsigned SDI1R:7; unsigned :9; } RPINR20BITS;
+typedef struct { unsigned RP64R:6; unsigned :10; } RPOR0BITS;
+typedef struct { unsigned RP108R:6; unsigned :10; } RPOR11BITS;
+typedef struct { unsigned RP109R:6; unsigned :10; } RPOR12BITS;
+extern volatile RPINR18BITS RPINR18bits;
+extern volatile RPINR20BITS RPINR20bits;
+extern volatile RPOR0BITS RPOR0bits;
+extern volatile RPOR11BITS RPOR11bits;
+extern volatile RPOR12BITS RPOR12bits;
+
+// data registers, see HAL_SPI1_* and HAL_U1_* in hal.h
+void hal_host_spi1_write(unsigned int data);
+unsigned int hal_host_spi1_read(void);
+void hal_host_u1_write(unsigned int data);
+unsigned int hal_host_u1_read(void);
+
+// DMA addresses, see HAL_DMA0_* in hal.h
+void hal_host_dma0_source(const volatile void *p);
+void hal_host_dma0_peripheral(volatile void *p);
+
+// global interrupt masking, see HAL_IRQ_DISABLE in hal.h
+int hal_host_irq_disable(void);
+void hal_host_irq_restore(int saved);
+
+// advances the simulated clock to the next peripheral event and dispatches
+// the enabled interrupts whose flag is set
+void hal_host_spin(void);
+
+// same as hal_host_spin(), with the time accounted as CPU idle
+void hal_host_idle(void);
+
+// current simulated time in instruction cycles
+uint64_t hal_host_cycles(void);
+
+// runs the simulated peripherals for the given number of cycles, as if the
+// CPU was busy executing code for that long
+void hal_host_cpu(unsigned long cycles);
+
+// main loop period of TIMER1 in cycles, 0 if the timer is stopped
+uint64_t hal_host_t1_period(void);
+
+// task profiling, see host/profile.c
+void hal_host_task_begin(const char *name);
+void hal_host_task_end(const char *name);
+void hal_host_deadline(int missed);
+void hal_host_profile_report(void);
+
+// interrupt service routines the backend may dispatch, the firmware defines
+// the ones it uses
+void _T1Interrupt(void);
+void _DMA0Interrupt(void);
+void _T2Interrupt(void);
+void _T3Interrupt(void);
+void _T4Interrupt(void);
+void _SPI1Interrupt(void);
+void _U1RXInterrupt(void);
+void _U1TXInterrupt(void);
+
+#endif	/* XC_HOST_H */
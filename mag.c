@@ -0,0 +1,123 @@
+#include "mag.h"
+#include "spi.h"
+#include "swtimer.h"
+#include "hal.h"
+
+#include <stdint.h>
+
+#define MAG_DATA_X_LSB 0x42
+#define MAG_READ 0x80
+#define MAG_DATA_LEN 6
+
+// the register address followed by 6 dummy bytes to clock the data out
+static const unsigned char burst_cmd[MAG_DATA_LEN + 1] = {MAG_DATA_X_LSB | MAG_READ};
+static unsigned char burst_rx[MAG_DATA_LEN + 1];
+
+// set from the SPI interrupt when the burst ends
+static volatile int reading_ready;
+
+static void burst_completed(struct SpiTransaction *t) {
+    reading_ready = 1;
+}
+
+static struct SpiTransaction burst_read = {
+    .device = SPI_MAG,
+    .tx = burst_cmd,
+    .rx = burst_rx,
+    .len = MAG_DATA_LEN + 1,
+    .done = burst_completed,
+    .completed = 1,
+};
+
+// wake-up sequence, every step writes a register and waits for the state
+// transition on the software timer
+#define MAG_WAKE_STEPS 2
+#define MAG_TRANSITION_TICKS (SWTIMER_MS(3) + 1) // at least 3 ms
+
+static const unsigned char wake_cmds[MAG_WAKE_STEPS][2] = {
+    {0x4B, 0x01}, // changing the magnetometer to sleep state
+    {0x4C, 0x00}, // changing the magnetometer to active state
+};
+static volatile int wake_step = -1; // MAG_WAKE_STEPS once active
+
+static struct SpiTransaction wake_write = {
+    .device = SPI_MAG,
+    .len = 2,
+    .completed = 1,
+};
+
+static void wake_transition_done(struct SwTimer *t);
+
+static struct SwTimer wake_timer = {
+    .callback = wake_transition_done,
+};
+
+static void wake_start_step() {
+    wake_write.tx = wake_cmds[wake_step];
+    spi_submit(&wake_write);
+    swtimer_start(&wake_timer, MAG_TRANSITION_TICKS);
+}
+
+static void wake_transition_done(struct SwTimer *t) {
+    if (++wake_step < MAG_WAKE_STEPS) {
+        wake_start_step();
+    }
+}
+
+void activate_magnetometer() {
+    //disabling accelerometer and gyroscope, the transactions drive CS_MAG
+    CS_ACC = 1;
+    CS_GYR = 1;
+    CS_MAG = 1;
+
+    wake_step = 0;
+    wake_start_step();
+}
+
+int mag_active() {
+    return wake_step == MAG_WAKE_STEPS;
+}
+
+int mag_start_read() {
+    if (!burst_read.completed) {
+        return 0;
+    }
+    reading_ready = 0;
+    return spi_submit(&burst_read);
+}
+
+// x and y are 13 bit values on bits 15:3, z is a 15 bit value on bits 15:1.
+// The word is assembled unsigned (a signed 16 bit int overflows on the
+// shift of a negative MSB), going through int16_t then sign extends it with
+// an arithmetic shift
+static int decode_xy(const unsigned char *lsb) {
+    return (int16_t)(((unsigned int)lsb[1] << 8 | lsb[0]) & 0xFFF8) >> 3;
+}
+
+static int decode_z(const unsigned char *lsb) {
+    return (int16_t)(((unsigned int)lsb[1] << 8 | lsb[0]) & 0xFFFE) >> 1;
+}
+
+int mag_get_reading(struct MagReading *reading) {
+    if (!reading_ready) {
+        return 0;
+    }
+    reading_ready = 0;
+
+    // burst_rx[0] was received while sending the address
+    reading->x = decode_xy(&burst_rx[1]);
+    reading->y = decode_xy(&burst_rx[3]);
+    reading->z = decode_z(&burst_rx[5]);
+    return 1;
+}
+
+struct MagReading mag_read() {
+    struct MagReading reading;
+
+    while (!mag_start_read()) {
+        HAL_SPIN();
+    }
+    spi_wait(&burst_read);
+    mag_get_reading(&reading);
+    return reading;
+}
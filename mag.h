@@ -0,0 +1,36 @@
+#ifndef MAG_H
+#define	MAG_H
+
+// to avoid overflow with sums it's better to use long
+struct MagReading {
+    long x;
+    long y;
+    long z;
+};
+
+/*
+Starts waking the magnetometer up: sleep mode, 3 ms, active mode, 3 ms. The
+waits run on a software timer (swtimer_init() must have been called), the
+function returns immediately and mag_active() tells when the sequence is over.
+*/
+void activate_magnetometer();
+
+int mag_active();
+
+/*
+Queues a burst read of the three axes: the chip select is asserted once, the
+address of the X LSB register is sent with the read bit and the six data
+registers are clocked out, so the three axes always come from the same
+sample. Returns 0 if the previous read is still in flight.
+*/
+int mag_start_read();
+
+/*
+Returns 1 and fills reading if a read completed since the last call.
+*/
+int mag_get_reading(struct MagReading *reading);
+
+// blocking read, for the initialization code
+struct MagReading mag_read();
+
+#endif	/* MAG_H */
@@ -1,16 +1,29 @@
 #include "timer.h"
 #include "uart.h"
 #include "spi.h"
+#include "mag.h"
+#include "filter.h"
+#include "fixmath.h"
+#include "format.h"
 #include "parser.h"
+#include "command.h"
+#include "telemetry.h"
+#include "scheduler.h"
+#include "swtimer.h"
+#include "hal.h"
 
-#include <xc.h>
-#include <string.h>
-#include <stdio.h>
-#include <math.h>
+
+// 1: parse_byte() runs in the RX interrupt and only the complete commands are
+// queued for the main loop, 0: the received bytes are queued in a ring and
+// parsed by the main loop
+#ifndef RX_PARSE_IN_ISR
+#define RX_PARSE_IN_ISR 1
+#endif
 
 // Since we use a 10 bit UART transmission we use 10 bits for a byte of data. 
-// With a 100Hz main we have 9,6 bytes per cycle
-#define INPUT_BUFF_LEN 10
+// With a 100Hz main we have 9,6 bytes per cycle, rounded up to the next
+// power of two for the ring
+#define INPUT_BUFF_LEN 16
 
 // considerations on MAG message:
 // for the x and y axis we have 2^13 bytes signed, which is equivalent to range:
@@ -25,55 +38,78 @@
 // with 10 bytes we can have a max of 2 RATE messages received
 // each ERR message is 7 bytes so 14 bytes max
 
-// considering the worst can in which we print all messages together:
-// - $MAG,,,* -> 8 bytes
-// - x, y axis -> 10 bytes max
-// - z axis -> 6 bytes max
-// - $YAW,* -> 6 bytes
-// - angle -> 4 bytes
-// - err message -> 14 bytes
-// total: 48 bytes
-#define OUTPUT_BUFF_LEN 48
+// every message type has its own output lane (see outq.h), sized for at least
+// one message with its checksum (the mailbox lanes hold just one), rounded up
+// to the next power of two:
+// - $MAG,,,* -> 8 bytes + 16 bytes of values + 2 -> 26 bytes
+// - $YAW,* -> 6 bytes + 4 bytes of angle + 2 -> 12 bytes
+// - err messages -> 14 bytes, a $STAT line 38 bytes at most
+#define MAG_BUFF_LEN 32
+#define YAW_BUFF_LEN 16
+#define CONTROL_BUFF_LEN 64
+
+#define MAIN_HZ 100
 
 // this define the frequency of the tasks based on the frequency of the main.
 #define CLOCK_LD_TOGGLE 50 // led2 blinking at 1Hz
 #define CLOCK_ACQUIRE_MAG 4 // acquiring magnetometer values at 25Hz
 #define CLOCK_YAW_PRINT 20 // printing yaw at 5Hz
 
-#define N_MAG_READINGS 5 // number of mag values to keep for the average
+#define DEFAULT_MAG_RATE 5 // printing mag at 5Hz until a RATE message arrives
 
-#define VALID_RATES_N 6
+// the average is computed on 2^MAG_AVG_LOG2_LEN mag values, a power of two
+// so that the division is a shift
+#define MAG_AVG_LOG2_LEN 2
+#define MAG_AVG_LEN (1 << MAG_AVG_LOG2_LEN)
 
-char input_buff[INPUT_BUFF_LEN];
-char output_buff[OUTPUT_BUFF_LEN];
-
-struct circular_buffer UART_input_buff = {
-    .len = INPUT_BUFF_LEN,
-    .buff = input_buff,
-};
+#define VALID_RATES_N 6
 
-struct circular_buffer UART_output_buff = {
-    .len = OUTPUT_BUFF_LEN,
-    .buff = output_buff,
+// MAG rate only accepted with binary telemetry, a 10 byte frame every
+// acquisition fits at 9600 baud while a text line does not
+#define BINARY_MAG_RATE (MAIN_HZ / CLOCK_ACQUIRE_MAG)
+
+// rough XC16 cost of the library calls that do not busy-wait, only used by the
+// host simulator to charge the CPU time they take
+#define PRINT_MSG_CYCLES 300
+#define ATAN2_CYCLES 150
+
+#if RX_PARSE_IN_ISR
+static struct CmdQueue command_queue;
+#else
+RING_DEFINE(UART_input_buff, INPUT_BUFF_LEN);
+#define RX_GAP_MARK '\0' // queued in place of the bytes lost by the receiver
+#endif
+RING_DEFINE(mag_buff, MAG_BUFF_LEN);
+RING_DEFINE(yaw_buff, YAW_BUFF_LEN);
+RING_DEFINE(control_buff, CONTROL_BUFF_LEN);
+
+static struct Mailbox yaw_mailbox = {.type = "YAW", .n_values = 1};
+static struct Mailbox mag_mailbox = {.type = "MAG", .n_values = 3};
+
+// the command replies are never dropped to make room, of the readings only
+// the latest one is sent
+static struct OutLane out_lanes[N_LANES] = {
+    [LANE_CONTROL] = OUTQ_LANE(control_buff, OUTQ_DROP_NEWEST),
+    [LANE_YAW] = OUTQ_MAILBOX_LANE(yaw_buff, yaw_mailbox),
+    [LANE_MAG] = OUTQ_MAILBOX_LANE(mag_buff, mag_mailbox),
 };
 
-// to avoid overflow with sums it's better to use long
-struct MagReading {
-    long x;
-    long y;
-    long z;
-};
+static int mag_window[3][MAG_AVG_LEN];
 
-struct MagReadings {
-    int w;
-    struct MagReading readings[N_MAG_READINGS];
+// state shared by the main loop tasks
+static struct MovingAverage mag_avg[3] = {
+    MOVING_AVERAGE_INIT(mag_window[0], MAG_AVG_LOG2_LEN),
+    MOVING_AVERAGE_INIT(mag_window[1], MAG_AVG_LOG2_LEN),
+    MOVING_AVERAGE_INIT(mag_window[2], MAG_AVG_LOG2_LEN),
 };
+static struct MagReading avg_reading;
+static int yaw_deg;
+static parser_state pstate = {.state = STATE_DOLLAR};
 
-enum Axis {
-    X_AXIS = 0,
-    Y_AXIS,
-    Z_AXIS,
-};
+// checks every tick for the characters left under the RX interrupt threshold,
+// armed by the RX interrupt only while a batch is being received
+static void rx_poll(struct SwTimer *t);
+static struct SwTimer rx_timer = {.callback = rx_poll, .period = 1};
 
 void algorithm() {
     tmr_wait_ms(TIMER2, 7);
@@ -81,7 +117,10 @@ void algorithm() {
 
 const int valid_rates_values[] = {0, 1, 2, 4, 5, 10};
 
-int is_valid_rate(int rate) {
+int is_valid_rate(long rate) {
+    if(rate == BINARY_MAG_RATE) {
+        return format_mode() == FORMAT_BINARY;
+    }
     for(int i = 0; i < VALID_RATES_N; i++){
         if(valid_rates_values[i] == rate){
             return 1;
@@ -90,185 +129,302 @@ int is_valid_rate(int rate) {
     return 0;
 }
 
-void activate_magnetometer() {
-    //selecting the magnetometer and disabling accelerometer and gyroscope
-    CS_ACC = 1;
-    CS_GYR = 1;
-    
-    CS_MAG = 0;
-    spi_write(0x4B);
-    spi_write(0x01); // changing the magnetometer to sleep state
-    CS_MAG = 1;
-
-    tmr_wait_ms(TIMER1, 3); //waiting for the magnetometer to go into sleep state
-    
-    CS_MAG = 0;
-    spi_write(0x4C);
-    spi_write(0x00); // changing the magnetometer to active state  
-    CS_MAG = 1;
-
-    tmr_wait_ms(TIMER1, 3); //waiting for the magnetometer to go into active state
+void toggle_led() {
+    LATGbits.LATG9 = !LATGbits.LATG9;
+}
+
+// only queues the SPI read, the main loop keeps going while it is in flight
+void acquire_mag() {
+    mag_start_read();
 }
 
-int read_mag_axis(enum Axis axis) {
-    int axis_value;
+void average_mag(const struct MagReading *reading) {
+    avg_reading.x = movavg_update(&mag_avg[0], reading->x);
+    avg_reading.y = movavg_update(&mag_avg[1], reading->y);
+    avg_reading.z = movavg_update(&mag_avg[2], reading->z);
+}
 
-    // the overflow should not happen by design. If it happens the LED1 is turned
-    // on to signal a bug in the code
-    if(SPI1STATbits.SPIROV){
-        SPI1STATbits.SPIROV = 0;
-        LATA = 1;
-    }
-    CS_MAG = 0;
-    // the axis registers are sequential
-    spi_write((0x42 + axis * 2)| 0x80); //writing the axis register to read
-
-    if (axis == X_AXIS || axis == Y_AXIS){
-        // converting to int and shifting the values
-        const int bytes_value = (spi_write(0x00) & 0x00F8) | (spi_write(0x00) << 8);
-        axis_value = bytes_value >> 3;
-    } else {
-        // converting to int and shifting the values
-        const int bytes_value = (spi_write(0x00) & 0x00FE) | (spi_write(0x00) << 8);
-        axis_value = bytes_value >> 1;
+void reset_mag(const struct MagReading *reading) {
+    movavg_reset(&mag_avg[0], reading->x);
+    movavg_reset(&mag_avg[1], reading->y);
+    movavg_reset(&mag_avg[2], reading->z);
+    avg_reading = *reading;
+}
+
+void process_mag() {
+    struct MagReading reading;
+    if (!mag_get_reading(&reading)) {
+        return;
     }
 
-    CS_MAG = 1;
-    return axis_value;
+    average_mag(&reading);
+    yaw_deg = atan2_cdeg(avg_reading.y, avg_reading.x) / 100;
+    HAL_CPU_CYCLES(ATAN2_CYCLES);
 }
 
-int main(void) {
-    init_uart();
-    init_spi();
+void print_mag() {
+    const long values[] = {avg_reading.x, avg_reading.y, avg_reading.z};
+    outq_post(&out_lanes[LANE_MAG], values);
+    HAL_CPU_CYCLES(PRINT_MSG_CYCLES); // formatted in the DMA interrupt, charged here
+}
 
-    int print_mag_rate = 5;
+void print_yaw() {
+    const long value = yaw_deg;
+    outq_post(&out_lanes[LANE_YAW], &value);
+    HAL_CPU_CYCLES(PRINT_MSG_CYCLES);
+}
 
-    struct MagReadings mag_readings = {0};
+void parse_uart();
+
+// Main loop tasks, in execution order. The magnetometer read is queued at
+// ticks 0, 4, 8, ... and processed two ticks later. The phases keep the
+// processing (ticks 2, 6, 10, ...), the MAG print (ticks ending in 3 for every
+// valid rate but 4Hz) and the YAW print (ticks 1, 21, 41, ...) on different
+// ticks; being exclusive, any remaining collision is resolved by postponing one
+// of them by a tick. The budgets come from the host simulator report plus margin.
+static struct SchedTask tasks[] = {
+    [TASK_ALGORITHM] = {
+        .id = TASK_ALGORITHM, .run = algorithm,
+        .period = 1, .phase = 0, .budget = US_TO_TICKS(7100),
+    },
+    [TASK_LED_TOGGLE] = {
+        .id = TASK_LED_TOGGLE, .run = toggle_led,
+        .period = CLOCK_LD_TOGGLE, .phase = 0, .budget = US_TO_TICKS(10),
+    },
+    [TASK_MAG_ACQUIRE] = {
+        .id = TASK_MAG_ACQUIRE, .run = acquire_mag,
+        .period = CLOCK_ACQUIRE_MAG, .phase = 0, .budget = US_TO_TICKS(10),
+    },
+    [TASK_MAG_PROCESS] = {
+        .id = TASK_MAG_PROCESS, .run = process_mag,
+        .period = CLOCK_ACQUIRE_MAG, .phase = 2, .budget = US_TO_TICKS(100),
+        .exclusive = 1,
+    },
+    [TASK_MAG_PRINT] = {
+        .id = TASK_MAG_PRINT, .run = print_mag,
+        .period = MAIN_HZ / DEFAULT_MAG_RATE, .phase = 3, .budget = US_TO_TICKS(60),
+        .exclusive = 1,
+    },
+    [TASK_YAW_PRINT] = {
+        .id = TASK_YAW_PRINT, .run = print_yaw,
+        .period = CLOCK_YAW_PRINT, .phase = 1, .budget = US_TO_TICKS(60),
+        .exclusive = 1,
+    },
+    [TASK_UART_PARSE] = {
+        .id = TASK_UART_PARSE, .run = parse_uart,
+        .period = 1, .phase = 0, .budget = US_TO_TICKS(100),
+    },
+};
 
-    UART_input_buff.buff = input_buff;
-    UART_output_buff.buff = output_buff;
+#define N_SCHED_TASKS (int)(sizeof(tasks) / sizeof(tasks[0]))
 
-    TRISA = TRISG = 0x0000; // setting port A and G as output
-    ANSELA = ANSELB = ANSELC = ANSELD = ANSELE = ANSELG = 0x0000; // disabling analog function
+int rate_command(const long *fields, int n_fields) {
+    if(!is_valid_rate(fields[0])) {
+        return -1;
+    }
+    const int rate = (int)fields[0];
+    scheduler_set_period(&tasks[TASK_MAG_PRINT], rate ? MAIN_HZ / rate : 0);
+    return 0;
+}
 
-    activate_magnetometer();
+int stat_command(const long *fields, int n_fields) {
+    telemetry_request_report();
+    return 0;
+}
 
-    // our largerst string is 20 bytes, this should be changed in case of differnt print messages
-    char output_str [20]; 
+int baud_command(const long *fields, int n_fields) {
+    return fields[0] > 0 ? uart_request_baud((unsigned long)fields[0]) : -1;
+}
 
-    int LD2_toggle_counter = 0;
-    int acquire_mag_counter = 0;
-    int print_mag_counter = 0;
-    int print_yaw_counter = 0;
+// checksums on both directions, the command itself follows the current setting.
+// The parser switches in csum_parsed(), this is the output side
+int csum_command(const long *fields, int n_fields) {
+    if(fields[0] != 0 && fields[0] != 1) {
+        return -1;
+    }
+    format_set_checksum((int)fields[0]);
+    return 0;
+}
 
+// called when a $CSUM is parsed: in the RX interrupt the frames behind it are
+// parsed before the command runs, and must already follow the new setting
+static void csum_parsed(const parser_state *ps) {
+    if(ps->n_fields == 1 && (ps->fields[0] == 0 || ps->fields[0] == 1)) {
+        pstate.checksum = (int)ps->fields[0];
+    }
+}
 
-    struct MagReading avg_reading = {0};
-    int yaw_deg = 0;
+// output encoding, commands are always received as text
+int mode_command(const long *fields, int n_fields) {
+    if(fields[0] != FORMAT_TEXT && fields[0] != FORMAT_BINARY) {
+        return -1;
+    }
+    format_set_mode((int)fields[0]);
+    if(fields[0] == FORMAT_TEXT && tasks[TASK_MAG_PRINT].period == MAIN_HZ / BINARY_MAG_RATE) {
+        scheduler_set_period(&tasks[TASK_MAG_PRINT], MAIN_HZ / 10); // fastest text rate
+    }
+    return 0;
+}
 
-    parser_state pstate = {.state = STATE_DOLLAR };
+// commands accepted on the UART, looked up by the packed message type
+static const struct Command commands[] = {
+    {.key = MSG_KEY("RATE"), .min_fields = 1, .max_fields = 1,
+     .handler = rate_command, .error = 1},
+    {.key = MSG_KEY("STAT"), .min_fields = 0, .max_fields = 0,
+     .handler = stat_command},
+    {.key = MSG_KEY("BAUD"), .min_fields = 1, .max_fields = 1,
+     .handler = baud_command, .error = 2},
+    {.key = MSG_KEY("CSUM"), .min_fields = 1, .max_fields = 1,
+     .handler = csum_command, .error = 3},
+    {.key = MSG_KEY("MODE"), .min_fields = 1, .max_fields = 1,
+     .handler = mode_command, .error = 4},
+};
+
+#define N_COMMANDS (int)(sizeof(commands) / sizeof(commands[0]))
 
-    // filling the array of magnetormeter readings to ensure that the first 
-    // average value computed is right
-    tmr_setup_period(TIMER1, 40); // setting the same period as in the main
-    for (int i = 0; i < N_MAG_READINGS; ++i) {
-        mag_readings.readings[i] = (struct MagReading) {
-            .x = read_mag_axis(X_AXIS),
-            .y = read_mag_axis(Y_AXIS),
-            .z = read_mag_axis(Z_AXIS),
-        };
-        tmr_wait_period(TIMER1);
+void run_command(const struct Command *cmd, const long *fields, int n_fields) {
+    if(cmd && cmd_run(cmd, fields, n_fields) < 0 && cmd->error) {
+        const long code = cmd->error;
+        print_msg(&out_lanes[LANE_CONTROL], "ERR", &code, 1);
     }
+}
 
-    const int main_hz = 100;
-    tmr_setup_period(TIMER1, 1000 / main_hz); // 100 Hz frequency
+#if RX_PARSE_IN_ISR
+void parse_uart() {
+    struct CmdMessage msg;
+    while(cmd_queue_pop(&command_queue, &msg)) {
+        run_command(msg.cmd, msg.fields, msg.n_fields);
+    }
+    uart_baud_step();
+}
+#else
+void parse_uart() {
+    char byte;
+    while(ring_get(&UART_input_buff, &byte)) {
+        const int status = parse_byte(&pstate, byte);
+        if(status == NEW_MESSAGE) {
+            if(pstate.type_key == MSG_KEY("CSUM")) {
+                csum_parsed(&pstate);
+            }
+            run_command(cmd_find(pstate.type_key), pstate.fields, pstate.n_fields);
+        } else if(status < 0) { // any parser error
+            telemetry_frame_rejected();
+        }
+    }
+    uart_baud_step();
+}
+#endif
 
-    while (1) {
-        algorithm();
-        if (++LD2_toggle_counter >= CLOCK_LD_TOGGLE) {
-            LD2_toggle_counter = 0;
-            LATGbits.LATG9 = !LATGbits.LATG9;
+int main(void) {
+    // before the RX interrupt may look them up
+    if(!cmd_init(commands, N_COMMANDS)) {
+        // two commands share a slot of the index (see command.h): LED1 stays
+        // on to signal the bug instead of running without them
+        TRISA = 0x0000;
+        LATA = 1;
+        while(1) {
+            HAL_SPIN();
         }
+    }
+    init_uart(out_lanes, N_LANES);
+    uart_set_rx_threshold(1); // the line is quiet, see rx_poll()
+    init_spi();
+    swtimer_init();
 
-        if (++acquire_mag_counter >= CLOCK_ACQUIRE_MAG) {
-            acquire_mag_counter = 0;
+    activate_magnetometer();
 
-            mag_readings.readings[mag_readings.w] = (struct MagReading) {
-                .x = read_mag_axis(X_AXIS),
-                .y = read_mag_axis(Y_AXIS),
-                .z = read_mag_axis(Z_AXIS),
-            };
+    TRISA = TRISG = 0x0000; // setting port A and G as output
+    ANSELA = ANSELB = ANSELC = ANSELD = ANSELE = ANSELG = 0x0000; // disabling analog function
 
-            mag_readings.w = (mag_readings.w + 1) % N_MAG_READINGS;
+    while (!mag_active()) {
+        HAL_SPIN();
+    }
 
-            struct MagReading sum_reading = {0}; 
-            for(int i = mag_readings.w ; i != (mag_readings.w + 1) % N_MAG_READINGS; i = (i + 1) % N_MAG_READINGS) {
-                sum_reading.x += mag_readings.readings[i].x;
-                sum_reading.y += mag_readings.readings[i].y;
-                sum_reading.z += mag_readings.readings[i].z;
-            }
+    // filling the averages with a first magnetometer reading to ensure that
+    // the first average value computed is right
+    const struct MagReading first_reading = mag_read();
+    reset_mag(&first_reading);
 
-            avg_reading.x = sum_reading.x / N_MAG_READINGS,
-            avg_reading.y = sum_reading.y / N_MAG_READINGS,
-            avg_reading.z = sum_reading.z / N_MAG_READINGS,
+    scheduler_init(tasks, N_SCHED_TASKS);
+    tmr_setup_period(TIMER1, TMR_PERIOD_US(1000000UL / MAIN_HZ)); // 100 Hz frequency
 
-            yaw_deg = (int) (180.0 * atan2((float)avg_reading.y, (float)avg_reading.x) / M_PI);
-        }
+    while (1) {
+        telemetry_task_enter(TASK_LOOP);
+        scheduler_tick(tasks, N_SCHED_TASKS);
+        telemetry_report_step(out_lanes);
+        telemetry_task_exit(TASK_LOOP, NO_BUDGET);
 
-        if (print_mag_rate && ++print_mag_counter >= (main_hz / print_mag_rate)) {
-            print_mag_counter = 0;
-            sprintf(output_str, "$MAG,%d,%d,%d*", (int)avg_reading.x, (int)avg_reading.y, (int)avg_reading.z);
-            print_to_buff(output_str, &UART_output_buff);
-        }
+        telemetry_wait_period();
+    }
+    return 0;
+}
 
-        if (++print_yaw_counter >= CLOCK_YAW_PRINT) {
-            print_yaw_counter = 0;
-            sprintf(output_str, "$YAW,%d*", yaw_deg); 
-            print_to_buff(output_str, &UART_output_buff);
+// Drains the receive FIFO. Called by the RX interrupt every
+// UART_RX_THRESHOLD characters and by the TIMER3 tick for the shorter
+// batches: they have the same priority, so they never run at the same time
+static void receive() {
+    char read_char;
+    int result;
+    while((result = uart_rx_read(&read_char)) != UART_RX_NONE) {
+#if RX_PARSE_IN_ISR
+        if(result == UART_RX_ERROR) {
+            // the frame being parsed has a gap, wait for the next one
+            if(pstate.state != STATE_DOLLAR) {
+                pstate.state = STATE_DOLLAR;
+                telemetry_frame_rejected();
+            }
+            continue;
         }
-
-        while(UART_input_buff.read != UART_input_buff.write) {
-            const int status = parse_byte(&pstate, UART_input_buff.buff[UART_input_buff.read]);
-            if(status == NEW_MESSAGE) {
-                if(strcmp(pstate.msg_type, "RATE") == 0) {
-                    const int rate = extract_integer(pstate.msg_payload);
-                    if(is_valid_rate(rate)) {
-                        print_mag_rate = rate;
-                    } else {
-                        print_to_buff("$ERR,1*", &UART_output_buff);
-                    }
-                }
+        const int status = parse_byte(&pstate, read_char);
+        // the unknown commands are ignored here, they take no queue slot
+        const struct Command *cmd = status == NEW_MESSAGE ? cmd_find(pstate.type_key) : 0;
+        if(cmd) {
+            if(!cmd_queue_push(&command_queue, cmd, &pstate)) {
+                telemetry_command_dropped();
+            } else if(cmd->key == MSG_KEY("CSUM")) {
+                csum_parsed(&pstate);
             }
-            UART_input_buff.read = (UART_input_buff.read + 1) % INPUT_BUFF_LEN;
+        } else if(status < 0) { // any parser error
+            telemetry_frame_rejected();
+        }
+#else
+        // a gap is marked with a control character, which the parser
+        // rejects in the middle of a frame and ignores between frames
+        if(result == UART_RX_ERROR) {
+            read_char = RX_GAP_MARK;
+        }
+        if(!ring_put(&UART_input_buff, read_char)) {
+            telemetry_rx_byte_dropped();
         }
-        tmr_wait_period(TIMER1);
+#endif
     }
-    return 0;
 }
 
-void __attribute__((__interrupt__, no_auto_psv)) _U1TXInterrupt(void){
-    IFS0bits.U1TXIF = 0; // clear TX interrupt flag
-
-
-    if(UART_output_buff.read == UART_output_buff.write){
-        UART_INTERRUPT_TX_MANUAL_TRIG = 1;
-    } 
-
-    while(!U1STAbits.UTXBF && UART_output_buff.read != UART_output_buff.write){
-        U1TXREG = UART_output_buff.buff[UART_output_buff.read];
-        UART_output_buff.read = (UART_output_buff.read + 1) % OUTPUT_BUFF_LEN;
+// receive timeout: the receiver went idle with a partial batch in the FIFO.
+// Once the line is quiet the poll stops and the first character of the next
+// batch raises the RX interrupt on its own, which starts it again
+static void rx_poll(struct SwTimer *t) {
+    if(uart_rx_idle()) {
+        receive();
+    }
+    if(uart_rx_quiet()) {
+        uart_set_rx_threshold(1);
+        // a character received before the switch raised no interrupt
+        if(uart_rx_quiet()) {
+            swtimer_stop(t);
+            return;
+        }
+        uart_set_rx_threshold(UART_RX_THRESHOLD);
     }
 }
 
-void __attribute__((__interrupt__, no_auto_psv)) _U1RXInterrupt(void) {
+void HAL_ISR _U1RXInterrupt(void) {
     IFS0bits.U1RXIF = 0; //resetting the interrupt flag to 0
-
-    while(U1STAbits.URXDA) {
-        const char read_char = U1RXREG;
-
-        const int new_write_index = (UART_input_buff.write + 1) % INPUT_BUFF_LEN;
-        if (new_write_index != UART_input_buff.read) {
-            UART_input_buff.buff[UART_input_buff.write] = read_char;
-            UART_input_buff.write = new_write_index;
-        }
+    if(!swtimer_pending(&rx_timer)) {
+        // start of a batch: the rest of it is read every UART_RX_THRESHOLD
+        // characters and its tail by the poll
+        uart_set_rx_threshold(UART_RX_THRESHOLD);
+        swtimer_start(&rx_timer, 1);
     }
+    receive();
 }
@@ -0,0 +1,45 @@
+#include "outq.h"
+#include "uart.h"
+#include "format.h"
+#include "hal.h"
+
+int outq_reserve(struct OutLane *lane, unsigned int len) {
+    if (len > ring_free(lane->ring)) {
+        ++lane->drops;
+        return 0;
+    }
+    return 1;
+}
+
+void outq_commit(struct OutLane *lane, unsigned int n) {
+    ring_commit(lane->ring, n);
+    uart_tx_start();
+}
+
+void outq_post(struct OutLane *lane, const long *values) {
+    struct Mailbox *mb = lane->mailbox;
+
+    // the engine may format the message in the DMA interrupt at any time
+    int saved;
+    HAL_IRQ_DISABLE(saved);
+    if (mb->full) {
+        ++lane->drops;
+    }
+    for (int i = 0; i < mb->n_values; ++i) {
+        mb->values[i] = values[i];
+    }
+    mb->full = 1;
+    HAL_IRQ_RESTORE(saved);
+
+    uart_tx_start();
+}
+
+int outq_pull(struct OutLane *lane) {
+    struct Mailbox *mb = lane->mailbox;
+    if (!mb->full) {
+        return 0;
+    }
+    mb->full = 0;
+    // the lane is empty and holds a whole message, this never fails
+    return print_msg(lane, mb->type, mb->values, mb->n_values);
+}
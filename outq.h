@@ -0,0 +1,82 @@
+#ifndef OUTQ_H
+#define	OUTQ_H
+
+#include "ring.h"
+
+/*
+Output queue of the UART, split in lanes. Every lane is a ring of whole
+messages: the producer (the main loop) admits a message only if all of it
+fits, and the DMA engine (see uart.c) sends the lanes in priority order,
+switching lane only between messages: a full lane never truncates a message,
+and a low priority lane delays the higher ones at most by the messages it had
+queued when the engine picked it.
+*/
+
+// lanes of the firmware, in priority order
+enum OutLaneId {
+    LANE_CONTROL = 0, // replies to the commands: $ERR and the $STAT report
+    LANE_YAW,
+    LANE_MAG,
+    N_LANES,
+};
+
+#define OUTQ_DROP_NEWEST 0 // a message that does not fit is refused
+#define OUTQ_LATEST 1 // mailbox lane, only the latest values are sent
+
+#define OUTQ_MAILBOX_VALUES 3
+
+/*
+Latest values of a periodic message. The main loop posts them with
+outq_post(), overwriting the ones not sent yet, and the DMA engine formats
+the message into the lane only when it is about to send it: the reading on
+the wire is never older than the last one posted before the lane was picked,
+whatever the backlog of the other lanes.
+*/
+struct Mailbox {
+    const char *type;
+    int n_values;
+    long values[OUTQ_MAILBOX_VALUES];
+    volatile int full; // values posted and not formatted yet
+};
+
+struct OutLane {
+    struct ring *ring;
+    int policy; // OUTQ_DROP_NEWEST or OUTQ_LATEST
+    struct Mailbox *mailbox; // OUTQ_LATEST only
+    unsigned int drops; // messages refused, or values overwritten
+
+    // consumer side: the engine does not leave the lane before keep, and
+    // sends nothing past hold while a rate switch is pending
+    volatile unsigned int keep;
+    volatile unsigned int hold;
+
+    // producer side: mode switches of format.c seen by the last binary frame,
+    // the first frame after a switch starts with a delimiter
+    unsigned int mode_switches;
+};
+
+// lane initializers. Example: OUTQ_LANE(control_buff, OUTQ_DROP_NEWEST),
+// OUTQ_MAILBOX_LANE(mag_buff, mag_mailbox)
+#define OUTQ_LANE(r, p) {.ring = &(r), .policy = (p)}
+#define OUTQ_MAILBOX_LANE(r, mb) {.ring = &(r), .policy = OUTQ_LATEST, .mailbox = &(mb)}
+
+/*
+Checks that a message of len bytes fits, to be staged with ring_stage() and
+published with outq_commit(). Returns 0, counting the drop, if it does not.
+*/
+int outq_reserve(struct OutLane *lane, unsigned int len);
+
+// publishes the n staged bytes of a message and starts the transmission
+void outq_commit(struct OutLane *lane, unsigned int n);
+
+// replaces the values of a mailbox lane and starts the transmission
+void outq_post(struct OutLane *lane, const long *values);
+
+/*
+Called by the DMA engine on an empty mailbox lane: formats the posted values
+into it, returns 0 if there were none. The ring of a mailbox lane is
+written only here, so the engine is its producer as well as its consumer.
+*/
+int outq_pull(struct OutLane *lane);
+
+#endif	/* OUTQ_H */
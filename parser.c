@@ -1,70 +1,153 @@
 #include "parser.h"
 
+// magnitude limits of a 32 bit long
+#define FIELD_MAX 2147483647UL
+#define FIELD_MAX_NEGATIVE 2147483648UL
+
+static void start_field(parser_state* ps) {
+    ps->value = 0;
+    ps->field_len = 0;
+    ps->sign = 0;
+    ps->negative = 0;
+}
+
+// every error drops the frame, the parser waits for the next '$'
+static int reject(parser_state* ps, int error) {
+    ps->state = STATE_DOLLAR;
+    return error;
+}
+
+static int end_field(parser_state* ps) {
+    if (ps->field_len == 0) {
+        return EMPTY_FIELD; // nothing or just the sign
+    }
+    if (ps->n_fields == PARSER_MAX_FIELDS) {
+        return FIELD_OVERFLOW;
+    }
+    ps->fields[ps->n_fields++] = ps->negative
+        ? (long)(0UL - ps->value) : (long)ps->value;
+    start_field(ps);
+    return NO_MESSAGE;
+}
+
+// adds a digit to the field, checking the range before multiplying
+static int add_digit(parser_state* ps, int digit) {
+    const unsigned long limit = ps->negative ? FIELD_MAX_NEGATIVE : FIELD_MAX;
+    if (ps->value > limit / 10
+            || (ps->value == limit / 10 && (unsigned long)digit > limit % 10)) {
+        return INTEGER_OVERFLOW;
+    }
+    ps->value = ps->value * 10 + digit;
+    ps->field_len++;
+    return NO_MESSAGE;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// called on the '*': with checksums the message waits for the two hex digits
+static int end_message(parser_state* ps) {
+    if (ps->checksum) {
+        ps->state = STATE_CHECKSUM_HI;
+        return NO_MESSAGE;
+    }
+    ps->state = STATE_DOLLAR; // get ready for a new message
+    return NEW_MESSAGE;
+}
+
 int parse_byte(parser_state* ps, char byte) {
+    int status;
+
+    if (byte == '$') {
+        // always the start of a frame, even in the middle of another one
+        const int state = ps->state;
+        ps->state = STATE_TYPE;
+        ps->index_type = 0;
+        ps->type_key = 0;
+        ps->sum = 0;
+        if (state == STATE_CHECKSUM_HI || state == STATE_CHECKSUM_LO) {
+            return BAD_CHECKSUM;
+        }
+        return state == STATE_DOLLAR ? NO_MESSAGE : TRUNCATED_FRAME;
+    }
+
+    if ((ps->state == STATE_TYPE || ps->state == STATE_PAYLOAD) && byte != '*') {
+        ps->sum ^= (unsigned char)byte;
+    }
+
     switch (ps->state) {
         case STATE_DOLLAR:
-            if (byte == '$') {
-                ps->state = STATE_TYPE;
-                ps->index_type = 0;
-            }
             break;
         case STATE_TYPE:
-            if (byte == ',') {
-                ps->state = STATE_PAYLOAD;
-                ps->msg_type[ps->index_type] = '\0';
-                ps->index_payload = 0; // initialize properly the index
-            } else if (ps->index_type == 6) { // error! 
-                ps->state = STATE_DOLLAR;
-                ps->index_type = 0;
-			} else if (byte == '*') {
-				ps->state = STATE_DOLLAR; // get ready for a new message
+            if (byte == ',' || byte == '*') {
+                if (ps->index_type == 0) {
+                    return reject(ps, EMPTY_FIELD);
+                }
                 ps->msg_type[ps->index_type] = '\0';
-				ps->msg_payload[0] = '\0'; // no payload
-                return NEW_MESSAGE;
+                ps->n_fields = 0;
+                if (byte == '*') {
+                    return end_message(ps); // no payload
+                }
+                ps->state = STATE_PAYLOAD;
+                start_field(ps);
+            } else if (byte < ' ' || byte > '_') {
+                return reject(ps, BAD_CHARACTER);
+            } else if (ps->index_type == PARSER_MAX_TYPE) {
+                return reject(ps, TYPE_OVERFLOW);
             } else {
-                ps->msg_type[ps->index_type] = byte; // ok!
+                ps->msg_type[ps->index_type] = byte;
+                ps->type_key |= (unsigned long)(byte - ' ') << (MSG_KEY_BITS * ps->index_type);
                 ps->index_type++; // increment for the next time;
             }
             break;
         case STATE_PAYLOAD:
-            if (byte == '*') {
-                ps->state = STATE_DOLLAR; // get ready for a new message
-                ps->msg_payload[ps->index_payload] = '\0';
-                return NEW_MESSAGE;
-            } else if (ps->index_payload == 100) { // error
-                ps->state = STATE_DOLLAR;
-                ps->index_payload = 0;
+            if (byte == '*' || byte == ',') {
+                status = end_field(ps);
+                if (status < 0) {
+                    return reject(ps, status);
+                }
+                if (byte == '*') {
+                    return end_message(ps);
+                }
+            } else if (byte >= '0' && byte <= '9') {
+                status = add_digit(ps, byte - '0');
+                if (status < 0) {
+                    return reject(ps, status);
+                }
+            } else if ((byte == '-' || byte == '+') && ps->field_len == 0 && !ps->sign) {
+                ps->sign = 1;
+                ps->negative = byte == '-';
             } else {
-                ps->msg_payload[ps->index_payload] = byte; // ok!
-                ps->index_payload++; // increment for the next time;
+                return reject(ps, BAD_CHARACTER);
             }
             break;
+        case STATE_CHECKSUM_HI:
+        case STATE_CHECKSUM_LO: {
+            const int digit = hex_value(byte);
+            if (digit < 0) {
+                return reject(ps, BAD_CHECKSUM);
+            }
+            if (ps->state == STATE_CHECKSUM_HI) {
+                ps->expected = (unsigned char)(digit << 4);
+                ps->state = STATE_CHECKSUM_LO;
+                break;
+            }
+            ps->state = STATE_DOLLAR;
+            return (ps->expected | digit) == ps->sum ? NEW_MESSAGE : BAD_CHECKSUM;
+        }
+        default:
+            ps->state = STATE_DOLLAR; // never initialized, wait for a frame
+            break;
     }
     return NO_MESSAGE;
 }
-
-int extract_integer(const char* str) {
-	int i = 0, number = 0, sign = 1;
-	
-	if (str[i] == '-') {
-		sign = -1;
-		i++;
-	}
-	else if (str[i] == '+') {
-		sign = 1;
-		i++;
-	}
-	while (str[i] != ',' && str[i] != '\0') {
-		number *= 10; // multiply the current number by 10;
-		number += str[i] - '0'; // converting character to decimal number
-		i++;
-	}
-	return sign*number;
-}		
-
-int next_value(const char* msg, int i) {
-	while (msg[i] != ',' && msg[i] != '\0') { i++; }
-	if (msg[i] == ',')
-		i++;
-	return i;
-}
\ No newline at end of file
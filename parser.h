@@ -4,37 +4,70 @@
 #define STATE_DOLLAR  (1) // we discard everything until a dollar is found
 #define STATE_TYPE    (2) // we are reading the type of msg until a comma is found
 #define STATE_PAYLOAD (3) // we read the payload until an asterix is found
+#define STATE_CHECKSUM_HI (4) // first hex digit of the checksum
+#define STATE_CHECKSUM_LO (5) // second hex digit of the checksum
+
+// parse_byte() results, the negative ones reject the frame being parsed and
+// the parser waits for the next '$'. TRUNCATED_FRAME, and BAD_CHECKSUM for a
+// missing checksum, are returned on the '$' itself, which already starts the
+// next frame
 #define NEW_MESSAGE (1) // new message received and parsed completely
 #define NO_MESSAGE (0) // no new messages
+#define BAD_CHECKSUM (-1) // the checksum is missing or wrong
+#define TYPE_OVERFLOW (-2) // type longer than 5 characters
+#define FIELD_OVERFLOW (-3) // more than PARSER_MAX_FIELDS fields
+#define BAD_CHARACTER (-4) // not allowed in the type, or not part of an integer
+#define EMPTY_FIELD (-5) // empty type, or a field without digits
+#define INTEGER_OVERFLOW (-6) // field out of the 32 bit signed range
+#define TRUNCATED_FRAME (-7) // a '$' arrived before the end of the frame, a new one starts
+
+/*
+Message types are packed in an integer key while they are parsed, 6 bits per
+character (from ' ' to '_', so upper case letters, digits and most symbols)
+starting from the low bits: "RATE" is 'R' - ' ' | ('A' - ' ') << 6 | ...
+MSG_KEY() computes the key of a string literal at compile time.
+*/
+#define MSG_KEY_BITS 6
+// (s)[i] on a string literal is not an ISO C constant expression: MSG_KEY()
+// in a static initializer relies on a GCC extension, which XC16 inherits
+#define MSG_KEY_CHAR(s, i) ((i) < sizeof(s) - 1 \
+	? (unsigned long)((s)[(i) < sizeof(s) - 1 ? (i) : 0] - ' ') << (MSG_KEY_BITS * (i)) : 0UL)
+#define MSG_KEY(s) (MSG_KEY_CHAR(s, 0) | MSG_KEY_CHAR(s, 1) | MSG_KEY_CHAR(s, 2) \
+	| MSG_KEY_CHAR(s, 3) | MSG_KEY_CHAR(s, 4))
 
+#define PARSER_MAX_TYPE 5 // characters of the message type
+#define PARSER_MAX_FIELDS 4 // integer fields in a payload
+
+/*
+The payload is a list of comma separated integer fields, decoded as the
+bytes arrive: when the '*' is parsed the values are already in fields[] and
+nothing is rescanned. Messages without payload have no comma ($STAT*).
+*/
 typedef struct { 
 	int state;
-	char msg_type[6]; // type is 5 chars + string terminator
-	char msg_payload[100];  // assume payload cannot be longer than 100 chars
+	int checksum; // 1 if the messages end with *HH, the XOR of the bytes between '$' and '*'
+	unsigned char sum; // XOR of the bytes so far
+	unsigned char expected; // checksum received
+	unsigned long type_key; // see MSG_KEY
+	char msg_type[PARSER_MAX_TYPE + 1]; // type + string terminator
 	int index_type;
-	int index_payload;
+
+	long fields[PARSER_MAX_FIELDS];
+	int n_fields;
+	unsigned long value; // magnitude of the field being parsed
+	int field_len; // its digits so far
+	int sign; // 1 once a '+' or '-' has been read
+	int negative;
 } parser_state;
 
 /*
 Requires a pointer to a parser state, and the byte to process.
-returns NEW_MESSAGE if a message has been successfully parsed.
-The result can be found in msg_type and msg_payload.
-Parsing another byte will override the contents of those arrays.
+returns NEW_MESSAGE if a message has been successfully parsed, one of the
+negative codes above if the frame is rejected, NO_MESSAGE otherwise.
+The result can be found in type_key, msg_type, fields and n_fields.
+Parsing another byte will override them. Any byte sequence is accepted, the
+writes never go past the arrays.
 */
 int parse_byte(parser_state* ps, char byte);
 
-/*
-Takes a string as input, and converts it to an integer. Stops parsing when reaching
-the end of string or a ","
-the result is undefined if a wrong string is passed
-*/
-int extract_integer(const char* str);
-
-/*
-The function takes a string, and an index within the string, and returns the index where the next data can be found
-Example: with the string "10,20,30", and i=0 it will return 3. With the same string and i=3, it will return 6.
-*/  
-int next_value(const char* msg, int i);
-
 #endif	/* PARSER_H */
-
@@ -0,0 +1,57 @@
+#include "ring.h"
+
+#include <string.h>
+
+unsigned int ring_write(struct ring *r, const char *data, unsigned int n) {
+    const unsigned int head = r->head;
+    const unsigned int free = r->mask + 1 - (head - HAL_LOAD_ACQUIRE(&r->tail));
+    if (n > free) {
+        n = free;
+    }
+
+    const unsigned int start = head & r->mask;
+    const unsigned int first = r->mask + 1 - start; // room before the wrap
+    if (n <= first) {
+        memcpy(&r->buff[start], data, n);
+    } else {
+        memcpy(&r->buff[start], data, first);
+        memcpy(r->buff, data + first, n - first);
+    }
+
+    HAL_STORE_RELEASE(&r->head, head + n);
+    return n;
+}
+
+unsigned int ring_read(struct ring *r, char *data, unsigned int n) {
+    const unsigned int tail = r->tail;
+    const unsigned int used = HAL_LOAD_ACQUIRE(&r->head) - tail;
+    if (n > used) {
+        n = used;
+    }
+
+    const unsigned int start = tail & r->mask;
+    const unsigned int first = r->mask + 1 - start;
+    if (n <= first) {
+        memcpy(data, &r->buff[start], n);
+    } else {
+        memcpy(data, &r->buff[start], first);
+        memcpy(data + first, r->buff, n - first);
+    }
+
+    HAL_STORE_RELEASE(&r->tail, tail + n);
+    return n;
+}
+
+unsigned int ring_span(const struct ring *r, const char **span) {
+    const unsigned int tail = r->tail;
+    const unsigned int start = tail & r->mask;
+    const unsigned int used = HAL_LOAD_ACQUIRE(&r->head) - tail;
+    const unsigned int first = r->mask + 1 - start;
+
+    *span = &r->buff[start];
+    return used < first ? used : first;
+}
+
+void ring_consume(struct ring *r, unsigned int n) {
+    HAL_STORE_RELEASE(&r->tail, r->tail + n);
+}
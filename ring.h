@@ -0,0 +1,97 @@
+#ifndef RING_H
+#define	RING_H
+
+#include "hal.h"
+
+// Single-producer single-consumer byte ring. The capacity is a power of two
+// fixed at compile time: head and tail run freely and are masked on access,
+// so there is no modulo and all the slots can be used (used = head - tail,
+// which stays right across the wrap of the unsigned indices).
+//
+// The producer and the consumer may run in different contexts (main loop and
+// an ISR) without disabling interrupts, under this contract:
+// - exactly one context calls the producer functions (put, write, stage,
+//   commit) and exactly one calls the consumer ones (get, read, span,
+//   consume);
+// - each index has a single writer, head the producer and tail the consumer,
+//   and is stored with one 16 bit write so the other side never sees half an
+//   update;
+// - the producer fills the slots before publishing head (release) and the
+//   consumer empties them before publishing tail (release); the other side
+//   loads the index (acquire) before touching the slots, so it only sees
+//   bytes that are complete and only reuses slots that are released.
+// used and free are snapshots: exact for the caller's own side, possibly
+// stale (never too optimistic) for the other one.
+struct ring {
+    char *buff;
+    unsigned int mask; // capacity - 1
+    volatile unsigned int head; // next slot to write, moved only by the producer
+    volatile unsigned int tail; // next slot to read, moved only by the consumer
+};
+
+// Defines a ring with its storage, failing to compile if the capacity is not
+// a power of two. Example: RING_DEFINE(UART_input_buff, 16);
+#define RING_DEFINE(name, capacity) \
+    typedef char name##_capacity_must_be_a_power_of_two \
+        [(capacity) > 0 && ((capacity) & ((capacity) - 1)) == 0 ? 1 : -1]; \
+    static char name##_storage[capacity]; \
+    struct ring name = {.buff = name##_storage, .mask = (capacity) - 1}
+
+static inline unsigned int ring_used(const struct ring *r) {
+    return HAL_LOAD_ACQUIRE(&r->head) - HAL_LOAD_ACQUIRE(&r->tail);
+}
+
+static inline unsigned int ring_free(const struct ring *r) {
+    return r->mask + 1 - ring_used(r);
+}
+
+// single byte push, returns 0 if the ring is full
+static inline int ring_put(struct ring *r, char c) {
+    const unsigned int head = r->head;
+    if (head - HAL_LOAD_ACQUIRE(&r->tail) > r->mask) {
+        return 0;
+    }
+    r->buff[head & r->mask] = c;
+    HAL_STORE_RELEASE(&r->head, head + 1);
+    return 1;
+}
+
+// single byte pop, returns 0 if the ring is empty
+static inline int ring_get(struct ring *r, char *c) {
+    const unsigned int tail = r->tail;
+    if (HAL_LOAD_ACQUIRE(&r->head) == tail) {
+        return 0;
+    }
+    *c = r->buff[tail & r->mask];
+    HAL_STORE_RELEASE(&r->tail, tail + 1);
+    return 1;
+}
+
+/*
+Bulk push and pop: copy up to n bytes with at most two memcpy (before and
+after the end of the storage) and return the number of bytes copied.
+*/
+unsigned int ring_write(struct ring *r, const char *data, unsigned int n);
+unsigned int ring_read(struct ring *r, char *data, unsigned int n);
+
+/*
+Zero-copy consumer side: returns the number of bytes readable in one
+contiguous span starting at *span, to be released with ring_consume().
+*/
+unsigned int ring_span(const struct ring *r, const char **span);
+void ring_consume(struct ring *r, unsigned int n);
+
+/*
+Zero-copy producer side: ring_stage() writes a byte offset bytes past the
+head without publishing it (the caller checks ring_free() first),
+ring_commit() publishes n staged bytes at once.
+*/
+static inline void ring_stage(struct ring *r, unsigned int offset, char c) {
+    r->buff[(r->head + offset) & r->mask] = c;
+}
+
+static inline void ring_commit(struct ring *r, unsigned int n) {
+    HAL_STORE_RELEASE(&r->head, r->head + n);
+}
+
+#endif	/* RING_H */
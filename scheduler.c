@@ -0,0 +1,65 @@
+#include "scheduler.h"
+
+static unsigned long tick;
+
+// the tick count wraps, the difference is what matters
+static int is_released(const struct SchedTask *task) {
+    return task->period && (long)(tick - task->next_release) >= 0;
+}
+
+void scheduler_init(struct SchedTask *tasks, int n_tasks) {
+    tick = 0;
+    for (int i = 0; i < n_tasks; ++i) {
+        tasks[i].next_release = tasks[i].phase;
+        tasks[i].late = 0;
+    }
+}
+
+void scheduler_tick(struct SchedTask *tasks, int n_tasks) {
+    int exclusive_ran = 0;
+
+    for (int i = 0; i < n_tasks; ++i) {
+        struct SchedTask *task = &tasks[i];
+
+        if (!is_released(task)) {
+            continue;
+        }
+        if (task->exclusive) {
+            if (exclusive_ran && !task->late) {
+                task->late = 1;
+                continue;
+            }
+            exclusive_ran = 1;
+        }
+        task->late = 0;
+
+        telemetry_task_enter(task->id);
+        task->run();
+        telemetry_task_exit(task->id, task->budget);
+
+        task->next_release += task->period;
+        if (is_released(task)) {
+            // the period was shortened while we were behind, restart from now
+            task->next_release = tick + task->period;
+        }
+    }
+    ++tick;
+}
+
+void scheduler_set_period(struct SchedTask *task, unsigned int period) {
+    if (period == task->period) {
+        return;
+    }
+    task->period = period;
+    task->late = 0;
+    if (!period) {
+        return;
+    }
+
+    // first tick after the current one with the same phase
+    unsigned long release = tick - tick % period + task->phase % period;
+    if ((long)(release - tick) <= 0) {
+        release += period;
+    }
+    task->next_release = release;
+}
@@ -0,0 +1,41 @@
+#ifndef SCHEDULER_H
+#define	SCHEDULER_H
+
+#include "telemetry.h"
+
+// TIMER1 runs at FCY / 64 = 1.125 MHz with the 10 ms main period
+#define US_TO_TICKS(us) ((us) * 9UL / 8UL)
+
+struct SchedTask {
+    enum Task id;
+    void (*run)(void);
+    unsigned int period; // in main loop ticks, 0 disables the task
+    unsigned int phase; // tick of the first release, must be smaller than the period
+    unsigned int budget; // expected worst run time in TIMER1 ticks
+    int exclusive; // exclusive tasks never run in the same tick
+
+    // runtime state, handled by the scheduler
+    unsigned long next_release;
+    int late;
+};
+
+/*
+Resets the tick count and releases every task at its phase.
+*/
+void scheduler_init(struct SchedTask *tasks, int n_tasks);
+
+/*
+Runs, in table order, the tasks released at the current tick and advances the
+tick count. Must be called once per main loop period.
+An exclusive task released in a tick where another exclusive task already ran
+is postponed to the next tick, where it runs in any case; the following
+releases stay on the original phase.
+*/
+void scheduler_tick(struct SchedTask *tasks, int n_tasks);
+
+/*
+Changes the period of a task keeping its phase, 0 disables it.
+*/
+void scheduler_set_period(struct SchedTask *task, unsigned int period);
+
+#endif	/* SCHEDULER_H */
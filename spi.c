@@ -1,15 +1,73 @@
 #include "spi.h"
+#include "hal.h"
 
-#include <xc.h>
+// transaction queue, head is the one in flight
+static struct SpiTransaction *volatile queue_head;
+static struct SpiTransaction *queue_tail;
+static volatile int byte_index;
 
-unsigned int spi_write(unsigned int data) {
-    while (SPI1STATbits.SPITBF == 1);
+static void set_cs(enum SpiDevice device, int level) {
+    switch (device) {
+        case SPI_ACC:
+            CS_ACC = level;
+            break;
+        case SPI_GYR:
+            CS_GYR = level;
+            break;
+        case SPI_MAG:
+            CS_MAG = level;
+            break;
+    }
+}
 
-    SPI1BUF = data;
-    
-    while (SPI1STATbits.SPIRBF == 0);
+static void send_byte(const struct SpiTransaction *t) {
+    HAL_SPI1_WRITE(t->tx ? t->tx[byte_index] : 0x00);
+}
+
+static void start_transaction(struct SpiTransaction *t) {
+    byte_index = 0;
+    set_cs(t->device, 0);
+    send_byte(t);
+}
 
-    return SPI1BUF; // read to prevent buffer overrun
+int spi_submit(struct SpiTransaction *t) {
+    if (t->len <= 0) {
+        t->completed = 1;
+        return 1;
+    }
+
+    // the queue is shared with the SPI interrupt and with whatever other
+    // interrupt submits transactions (software timer callbacks)
+    int ipl;
+    HAL_IRQ_DISABLE(ipl);
+    for (const struct SpiTransaction *q = queue_head; q; q = q->next) {
+        if (q == t) {
+            HAL_IRQ_RESTORE(ipl);
+            return 0;
+        }
+    }
+
+    t->completed = 0;
+    t->next = 0;
+    if (queue_head) {
+        queue_tail->next = t;
+        queue_tail = t;
+    } else {
+        queue_head = queue_tail = t;
+        start_transaction(t);
+    }
+    HAL_IRQ_RESTORE(ipl);
+    return 1;
+}
+
+void spi_wait(const struct SpiTransaction *t) {
+    while (!t->completed) {
+        HAL_SPIN();
+    }
+}
+
+int spi_busy() {
+    return queue_head != 0;
 }
 
 void init_spi() {
@@ -18,8 +76,8 @@ void init_spi() {
     SPI1CON1bits.MSTEN = 1; // master mode 
     SPI1CON1bits.MODE16 = 0; // 8-bit mode 
  
-    // since for the SPI we wait actively for the readings, we set the maximum 
-    // frequency possible 
+    // the transfers are interrupt driven, but a byte takes only 16 cycles so
+    // we keep the maximum frequency possible 
     SPI1CON1bits.PPRE = 3; // 1:1 primary prescaler
     SPI1CON1bits.SPRE = 6; // 2:1 secondary prescaler
     
@@ -37,4 +95,43 @@ void init_spi() {
         
     SPI1STATbits.SPIEN = 1; // enable SPI
     SPI1CON1bits.CKP = 1; // Set clock idle state to high
+
+    IFS0bits.SPI1IF = 0;
+    IEC0bits.SPI1IE = 1; // interrupt at the end of every byte
+}
+
+void HAL_ISR _SPI1Interrupt(void) {
+    IFS0bits.SPI1IF = 0;
+
+    struct SpiTransaction *t = queue_head;
+    if (!t) {
+        return; // nothing in flight
+    }
+
+    // the overflow should not happen by design. If it happens the LED1 is turned
+    // on to signal a bug in the code
+    if (SPI1STATbits.SPIROV) {
+        SPI1STATbits.SPIROV = 0;
+        LATA = 1;
+    }
+
+    const unsigned char received = HAL_SPI1_READ();
+    if (t->rx) {
+        t->rx[byte_index] = received;
+    }
+
+    if (++byte_index < t->len) {
+        send_byte(t);
+        return;
+    }
+
+    set_cs(t->device, 1);
+    queue_head = t->next;
+    t->completed = 1;
+    if (t->done) {
+        t->done(t);
+    }
+    if (queue_head) {
+        start_transaction(queue_head);
+    }
 }
@@ -5,8 +5,41 @@
 #define CS_GYR PORTBbits.RB4
 #define CS_MAG PORTDbits.RD6
 
-unsigned int spi_write(unsigned int data);
+enum SpiDevice {
+    SPI_ACC = 0,
+    SPI_GYR,
+    SPI_MAG,
+};
+
+// An asynchronous SPI transaction: the chip select of the device is asserted,
+// len bytes are exchanged and the chip select is released. The struct is
+// owned by the caller and must stay alive until completed is set.
+struct SpiTransaction {
+    enum SpiDevice device;
+    const unsigned char *tx; // bytes to send, NULL sends zeros
+    unsigned char *rx; // received bytes, NULL discards them
+    int len;
+
+    // called from the SPI interrupt when the transaction ends, may be NULL
+    void (*done)(struct SpiTransaction *t);
+
+    volatile int completed; // set by the interrupt, cleared by spi_submit()
+    struct SpiTransaction *next; // queue link, handled by the driver
+};
+
+/*
+Queues a transaction and returns immediately. Transactions are executed in
+submission order by the SPI1 interrupt. Returns 0 if the transaction is
+already queued.
+*/
+int spi_submit(struct SpiTransaction *t);
+
+// busy-waits until the transaction is completed
+void spi_wait(const struct SpiTransaction *t);
+
+// 1 while a transaction is queued or in flight
+int spi_busy();
+
 void init_spi();
 
 #endif	/* SPI_H */
-
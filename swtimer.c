@@ -0,0 +1,126 @@
+#include "swtimer.h"
+#include "timer.h"
+#include "hal.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+// wheel[0][i] holds the timers expiring at the tick i (mod 64) of the next
+// 64, wheel[1][i] the ones expiring in the block of 64 ticks i (mod 64)
+static struct SwTimer *wheel[2][WHEEL_SLOTS];
+static unsigned long ticks;
+static unsigned int n_pending; // TIMER3 only runs while some timer is pending
+
+static void wheel_link(struct SwTimer *t) {
+    struct SwTimer **slot;
+    const unsigned long blocks = (t->expires >> WHEEL_BITS) - (ticks >> WHEEL_BITS);
+
+    if (t->expires - ticks < WHEEL_SLOTS) {
+        slot = &wheel[0][t->expires & WHEEL_MASK];
+    } else if (blocks < WHEEL_SLOTS) {
+        slot = &wheel[1][(t->expires >> WHEEL_BITS) & WHEEL_MASK];
+    } else {
+        // out of range: the last block, from where it is linked again
+        slot = &wheel[1][((ticks >> WHEEL_BITS) + WHEEL_MASK) & WHEEL_MASK];
+    }
+
+    t->slot = slot;
+    t->prev = 0;
+    t->next = *slot;
+    if (*slot) {
+        (*slot)->prev = t;
+    }
+    *slot = t;
+    ++n_pending;
+}
+
+static void wheel_unlink(struct SwTimer *t) {
+    if (t->prev) {
+        t->prev->next = t->next;
+    } else {
+        *t->slot = t->next;
+    }
+    if (t->next) {
+        t->next->prev = t->prev;
+    }
+    t->slot = 0;
+    --n_pending;
+}
+
+// the tick count stands still while the wheel is empty: a timer started then
+// expires exactly after its delay
+static void tick_start(void) {
+    if (!T3CONbits.TON) {
+        TMR3 = 0;
+        IFS0bits.T3IF = 0;
+        T3CONbits.TON = 1;
+    }
+}
+
+static void tick_stop_if_idle(void) {
+    if (n_pending == 0) {
+        T3CONbits.TON = 0;
+    }
+}
+
+void swtimer_init() {
+    tmr_setup_period(TIMER3, TMR_PERIOD_US(SWTIMER_TICK_US));
+    T3CONbits.TON = 0; // until a timer is started
+    IEC0bits.T3IE = 1;
+}
+
+void swtimer_start(struct SwTimer *t, unsigned int delay) {
+    int ipl;
+    HAL_IRQ_DISABLE(ipl);
+    if (t->slot) {
+        wheel_unlink(t);
+    }
+    t->expires = ticks + (delay ? delay : 1);
+    wheel_link(t);
+    tick_start();
+    HAL_IRQ_RESTORE(ipl);
+}
+
+void swtimer_stop(struct SwTimer *t) {
+    int ipl;
+    HAL_IRQ_DISABLE(ipl);
+    if (t->slot) {
+        wheel_unlink(t);
+        tick_stop_if_idle();
+    }
+    HAL_IRQ_RESTORE(ipl);
+}
+
+int swtimer_pending(const struct SwTimer *t) {
+    return t->slot != 0;
+}
+
+void HAL_ISR _T3Interrupt(void) {
+    IFS0bits.T3IF = 0;
+    ++ticks;
+
+    // entering a new block: its timers move down to the first level
+    if ((ticks & WHEEL_MASK) == 0) {
+        struct SwTimer **slot = &wheel[1][(ticks >> WHEEL_BITS) & WHEEL_MASK];
+        struct SwTimer *t;
+        while ((t = *slot)) {
+            wheel_unlink(t);
+            wheel_link(t);
+        }
+    }
+
+    // everything in the slot expires now. Periodic timers are linked again
+    // before the callback so that it can stop them
+    struct SwTimer **slot = &wheel[0][ticks & WHEEL_MASK];
+    struct SwTimer *t;
+    while ((t = *slot)) {
+        wheel_unlink(t);
+        if (t->period) {
+            t->expires += t->period;
+            wheel_link(t);
+        }
+        t->callback(t);
+    }
+    tick_stop_if_idle();
+}
@@ -0,0 +1,44 @@
+#ifndef SWTIMER_H
+#define	SWTIMER_H
+
+// Software timers multiplexed on TIMER3, which interrupts every tick while a
+// timer is pending and is stopped when none is, so an empty wheel does not
+// wake the CPU. Pending timers sit in a two level timer wheel: 64 slots of
+// one tick for the next 64 ticks and 64 slots of 64 ticks for the following
+// ~4 s, further ones are parked in the last slot and moved down as time
+// passes. Starting, stopping and expiring a timer are O(1).
+
+#define SWTIMER_TICK_US 1000UL
+#define SWTIMER_MS(ms) ((unsigned int)((ms) * 1000UL / SWTIMER_TICK_US))
+
+struct SwTimer {
+    // called from the TIMER3 interrupt: must be short and never busy-wait,
+    // it may start or stop any timer (itself included) and submit SPI
+    // transactions
+    void (*callback)(struct SwTimer *t);
+    unsigned int period; // in ticks, 0 for a one-shot timer
+
+    // handled by the service
+    unsigned long expires;
+    struct SwTimer *next, *prev;
+    struct SwTimer **slot; // list the timer is in, NULL if not pending
+};
+
+// sets TIMER3 up at SWTIMER_TICK_US and enables its interrupt, the timer
+// runs from the first swtimer_start()
+void swtimer_init();
+
+/*
+(Re)starts a timer to expire delay ticks from now, then every period ticks if
+the period is not 0. The current tick is already running, so the first
+expiry comes between delay - 1 and delay ticks from now: add one tick for a
+minimum wait. A delay of 0 counts as 1.
+*/
+void swtimer_start(struct SwTimer *t, unsigned int delay);
+
+// cancels a pending timer, nothing happens if it is not pending
+void swtimer_stop(struct SwTimer *t);
+
+int swtimer_pending(const struct SwTimer *t);
+
+#endif	/* SWTIMER_H */
@@ -0,0 +1,137 @@
+#include "telemetry.h"
+#include "timer.h"
+#include "format.h"
+#include "uart.h"
+#include "hal.h"
+
+#define NO_REPORT (-1)
+#define IDLE_WINDOW 100 // periods over which the idle fraction is measured
+
+struct Telemetry telemetry = {
+    .min_slack = 0xFFFF,
+};
+
+// names used by the host simulator report
+static const char *const task_names[N_TASKS] = {
+    "algorithm", "led_toggle", "mag_acquire", "mag_process", "mag_print",
+    "yaw_print", "uart_parse", "loop",
+};
+
+// next line of the report to send, -1 is the header, then the tasks and the
+// drop counters
+#define DROP_LINE N_TASKS
+#define RX_LINE (N_TASKS + 1)
+#define REPORT_DONE (N_TASKS + 2)
+#define REPORT_LINE_MAX 38 // $STAT with five 5 digit values and the checksum
+static int report_line = REPORT_DONE;
+
+static unsigned long idle_ticks; // in the current window
+static unsigned int idle_periods;
+
+// TMR1 restarts from 0 at every period, a task spanning the period match has
+// an exit timestamp smaller than the entry one
+static unsigned int ticks_between(unsigned int from, unsigned int to) {
+    return to >= from ? to - from : to + PR1 + 1 - from;
+}
+
+void telemetry_task_enter(enum Task task) {
+    HAL_TASK_BEGIN(task_names[task]);
+    telemetry.tasks[task].entry = TMR1;
+}
+
+void telemetry_task_exit(enum Task task, unsigned int budget) {
+    struct TaskTiming *t = &telemetry.tasks[task];
+
+    t->exit = TMR1;
+    const unsigned int duration = ticks_between(t->entry, t->exit);
+    if (duration > t->worst) {
+        t->worst = duration;
+    }
+    if (duration > budget) {
+        ++t->over_budget;
+    }
+    HAL_TASK_END(task_names[task]);
+}
+
+int telemetry_wait_period(void) {
+    const unsigned int elapsed = TMR1;
+    unsigned int idle;
+    const int missed = tmr_idle_period(TIMER1, &idle);
+
+    idle_ticks += idle;
+    if (++idle_periods == IDLE_WINDOW) {
+        telemetry.idle_permille = idle_ticks * 1000UL / (IDLE_WINDOW * ((unsigned long)PR1 + 1));
+        idle_ticks = 0;
+        idle_periods = 0;
+    }
+
+    if (missed) {
+        // the period already ended: TMR1 counts how late we are
+        ++telemetry.overruns;
+        if (elapsed > telemetry.worst_overrun) {
+            telemetry.worst_overrun = elapsed;
+        }
+    } else if (PR1 - elapsed < telemetry.min_slack) {
+        telemetry.min_slack = PR1 - elapsed;
+    }
+
+    HAL_DEADLINE(missed);
+    return missed;
+}
+
+void telemetry_request_report(void) {
+    report_line = NO_REPORT;
+}
+
+void telemetry_frame_rejected(void) {
+    ++telemetry.rejected_frames;
+}
+
+void telemetry_rx_byte_dropped(void) {
+    ++telemetry.rx_bytes_dropped;
+}
+
+void telemetry_command_dropped(void) {
+    ++telemetry.commands_dropped;
+}
+
+void telemetry_report_step(struct OutLane *lanes) {
+    struct OutLane *buff = &lanes[LANE_CONTROL];
+    // waiting for the room, instead of having the line refused, keeps the
+    // report out of the drop counters
+    if (report_line == REPORT_DONE || ring_free(buff->ring) < REPORT_LINE_MAX) {
+        return;
+    }
+
+    int queued;
+    if (report_line == NO_REPORT) {
+        const long values[] = {
+            telemetry.overruns, telemetry.worst_overrun, telemetry.min_slack,
+            telemetry.idle_permille, telemetry.rejected_frames,
+        };
+        queued = print_msg(buff, "STAT", values, 5);
+    } else if (report_line == DROP_LINE) {
+        long values[N_LANES];
+        for (int i = 0; i < N_LANES; ++i) {
+            values[i] = lanes[i].drops;
+        }
+        queued = print_msg(buff, "DROP", values, N_LANES);
+    } else if (report_line == RX_LINE) {
+        const long values[] = {
+            telemetry.rx_bytes_dropped, telemetry.commands_dropped,
+            uart_rx_errors.overruns, uart_rx_errors.framing, uart_rx_errors.parity,
+        };
+        queued = print_msg(buff, "RX", values, 5);
+    } else {
+        const struct TaskTiming *t = &telemetry.tasks[report_line];
+        const long values[] = {
+            report_line, t->entry, t->exit, t->worst, t->over_budget,
+        };
+        queued = print_msg(buff, "STAT", values, 5);
+    }
+
+    // partial messages are never queued, we retry on the next period
+    if (queued) {
+        ++report_line;
+    }
+}
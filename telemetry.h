@@ -0,0 +1,74 @@
+#ifndef TELEMETRY_H
+#define	TELEMETRY_H
+
+#include "outq.h"
+
+// tasks of the main loop whose timing is recorded
+enum Task {
+    TASK_ALGORITHM = 0,
+    TASK_LED_TOGGLE,
+    TASK_MAG_ACQUIRE,
+    TASK_MAG_PROCESS,
+    TASK_MAG_PRINT,
+    TASK_YAW_PRINT,
+    TASK_UART_PARSE,
+    TASK_LOOP, // the whole busy part of the period
+    N_TASKS,
+};
+
+#define NO_BUDGET 0xFFFF
+
+// all times are TIMER1 ticks (FCY / 64 with the 10 ms main period)
+struct TaskTiming {
+    unsigned int entry; // TMR1 at the last entry
+    unsigned int exit; // TMR1 at the last exit
+    unsigned int worst; // longest run so far
+    unsigned int over_budget; // runs longer than the budget
+};
+
+struct Telemetry {
+    unsigned int overruns; // periods in which tmr_idle_period() returned 1
+    unsigned int worst_overrun; // ticks already elapsed in the next period on the worst overrun
+    unsigned int min_slack; // ticks left before the deadline in the tightest on-time period
+    unsigned int idle_permille; // time the CPU spent in Idle over the last second, per mille
+    unsigned int rejected_frames; // received frames dropped by the parser (checksum or syntax)
+    unsigned int rx_bytes_dropped; // received bytes lost with the input ring full
+    unsigned int commands_dropped; // parsed commands lost with the command queue full
+    struct TaskTiming tasks[N_TASKS];
+};
+
+extern struct Telemetry telemetry;
+
+void telemetry_task_enter(enum Task task);
+// budget in TIMER1 ticks, runs longer than it are counted
+void telemetry_task_exit(enum Task task, unsigned int budget);
+
+/*
+Waits in Idle mode for the end of the main loop period on TIMER1, records if
+the deadline was missed and the idle time. Returns the value of
+tmr_idle_period().
+*/
+int telemetry_wait_period(void);
+
+/*
+Asks for a $STAT report. The report is written by telemetry_report_step(),
+one message at a time in the control lane, each one once the lane has room
+for the longest line:
+$STAT,<overruns>,<worst_overrun>,<min_slack>,<idle_permille>,<rejected_frames>*
+followed by one
+$STAT,<task>,<entry>,<exit>,<worst>,<over_budget>* per task and by the
+messages dropped in every output lane, see OutLane:
+$DROP,<control>,<yaw>,<mag>*
+and by the losses of the receive path, see also UartRxErrors:
+$RX,<rx_bytes_dropped>,<commands_dropped>,<overruns>,<framing>,<parity>*
+*/
+void telemetry_request_report(void);
+
+// count a received message rejected by the parser and the losses of the two
+// receive stages, safe to call from the RX interrupt
+void telemetry_frame_rejected(void);
+void telemetry_rx_byte_dropped(void);
+void telemetry_command_dropped(void);
+void telemetry_report_step(struct OutLane *lanes);
+
+#endif	/* TELEMETRY_H */
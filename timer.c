@@ -1,35 +1,13 @@
 #include "timer.h"
-#include <xc.h>
-#define MAX_DELAY 200
-
-#define FCY 72000000
-#define MAX_UINT16 65535
-
-void tmr_setup_period(int timer, int ms) {
-	if (ms <= 0) {
-		return;
-	}
-
-	const int prescalers[] = { 1, 8, 64, 256 };
-
-	const float s = (float)ms / 1000.;
-
-	// finding the smallest (best) prescaler who can wait the passed ms
-	float p = s * ((float)FCY / (float)MAX_UINT16);
-	int i = 0;
-	while (p > prescalers[i]) {
-		++i;
-	}
-	const int p_type = i;
-
-	const int clocks = (int)(s * (float)FCY / (float)(prescalers[p_type]));
+#include "hal.h"
 
+void tmr_setup_period(int timer, struct TmrPeriod period) {
 	switch (timer) {
 	case TIMER1:
 		T1CONbits.TON = 0;		  // stopping the timer
 		TMR1 = 0;				  // resetting the counter
-		T1CONbits.TCKPS = p_type; // setting the prescaler
-		PR1 = clocks;	   // loads the maximum number the timer can reach
+		T1CONbits.TCKPS = period.tckps; // setting the prescaler
+		PR1 = period.pr;	   // loads the maximum number the timer can reach
 		IFS0bits.T1IF = 0; // setting the flag to 0
 		T1CONbits.TON = 1; // re-starting the timer
 		break;
@@ -37,8 +15,8 @@ void tmr_setup_period(int timer, int ms) {
 	case TIMER2: // same as the other timer
 		T2CONbits.TON = 0;
 		TMR2 = 0;
-		T2CONbits.TCKPS = p_type;
-		PR2 = clocks;
+		T2CONbits.TCKPS = period.tckps;
+		PR2 = period.pr;
 		IFS0bits.T2IF = 0;
 		T2CONbits.TON = 1;
 		break;
@@ -46,8 +24,8 @@ void tmr_setup_period(int timer, int ms) {
 	case TIMER3: // same as the other timer
 		T3CONbits.TON = 0;
 		TMR3 = 0;
-		T3CONbits.TCKPS = p_type;
-		PR3 = clocks;
+		T3CONbits.TCKPS = period.tckps;
+		PR3 = period.pr;
 		IFS0bits.T3IF = 0;
 		T3CONbits.TON = 1;
 		break;
@@ -55,8 +33,8 @@ void tmr_setup_period(int timer, int ms) {
 	case TIMER4: // same as the other timer
 		T4CONbits.TON = 0;
 		TMR4 = 0;
-		T4CONbits.TCKPS = p_type;
-		PR4 = clocks;
+		T4CONbits.TCKPS = period.tckps;
+		PR4 = period.pr;
 		IFS1bits.T4IF = 0;
 		T4CONbits.TON = 1;
 		break;
@@ -75,7 +53,7 @@ int tmr_wait_period(int timer) {
 			ret = 1;
 		} else {
 			while (IFS0bits.T1IF == 0) {
-				;
+				HAL_SPIN();
 			}
 		}
 		IFS0bits.T1IF = 0;
@@ -86,7 +64,7 @@ int tmr_wait_period(int timer) {
 			ret = 1;
 		} else {
 			while (IFS0bits.T2IF == 0) {
-				;
+				HAL_SPIN();
 			}
 		}
 		IFS0bits.T2IF = 0;
@@ -97,7 +75,7 @@ int tmr_wait_period(int timer) {
 			ret = 1;
 		} else {
 			while (IFS0bits.T3IF == 0) {
-				;
+				HAL_SPIN();
 			}
 		}
 		IFS0bits.T3IF = 0;
@@ -108,7 +86,7 @@ int tmr_wait_period(int timer) {
 			ret = 1;
 		} else {
 			while (IFS1bits.T4IF == 0) {
-				;
+				HAL_SPIN();
 			}
 		}
 		IFS1bits.T4IF = 0;
@@ -119,10 +97,85 @@ int tmr_wait_period(int timer) {
 }
 
 void tmr_wait_ms(int timer, int ms) {
-	// with the adaptable prescaler I'm sure that we can wait 1ms exactly
-	tmr_setup_period(timer, 1);
+	tmr_setup_period(timer, TMR_PERIOD_MS(1));
 
 	for (int i = 0; i < ms; ++i) {
 		tmr_wait_period(timer);
 	}
 }
+
+/*
+Idles until the flag is set. The CPU priority is raised while checking the
+flag, so the period match cannot slip in between the check and the Idle
+instruction; an enabled interrupt still wakes the CPU, without vectoring,
+and is served when the priority is restored. Only the Idle time is counted.
+*/
+#define IDLE_UNTIL(IF, IE, TMR, PR, idle) \
+	do { \
+		int ipl; \
+		IE = 1; \
+		HAL_IRQ_DISABLE(ipl); \
+		while (IF == 0) { \
+			const unsigned int from = TMR; \
+			HAL_IDLE(); \
+			/* woken by the period match the counter restarted from 0 */ \
+			*(idle) += IF ? PR + 1 - from : TMR - from; \
+			HAL_IRQ_RESTORE(ipl); \
+			HAL_IRQ_DISABLE(ipl); \
+		} \
+		HAL_IRQ_RESTORE(ipl); \
+	} while (0)
+
+int tmr_idle_period(int timer, unsigned int *idle) {
+	*idle = 0;
+
+	int ret = 0;
+	switch (timer) {
+	case TIMER1:
+		if (IFS0bits.T1IF == 1) {
+			ret = 1;
+		} else {
+			IDLE_UNTIL(IFS0bits.T1IF, IEC0bits.T1IE, TMR1, PR1, idle);
+		}
+		IFS0bits.T1IF = 0;
+		break;
+
+	case TIMER2:
+		if (IFS0bits.T2IF == 1) {
+			ret = 1;
+		} else {
+			IDLE_UNTIL(IFS0bits.T2IF, IEC0bits.T2IE, TMR2, PR2, idle);
+		}
+		IFS0bits.T2IF = 0;
+		break;
+
+	case TIMER4:
+		if (IFS1bits.T4IF == 1) {
+			ret = 1;
+		} else {
+			IDLE_UNTIL(IFS1bits.T4IF, IEC1bits.T4IE, TMR4, PR4, idle);
+		}
+		IFS1bits.T4IF = 0;
+		break;
+
+	default: // TIMER3 interrupt belongs to the software timers
+		ret = tmr_wait_period(timer);
+		break;
+	}
+
+	return ret;
+}
+
+// the timer interrupts are enabled only to wake the CPU from Idle: they mask
+// themselves and leave the flag to tmr_idle_period()
+void HAL_ISR _T1Interrupt(void) {
+	IEC0bits.T1IE = 0;
+}
+
+void HAL_ISR _T2Interrupt(void) {
+	IEC0bits.T2IE = 0;
+}
+
+void HAL_ISR _T4Interrupt(void) {
+	IEC1bits.T4IE = 0;
+}
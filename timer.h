@@ -1,4 +1,4 @@
-#include <xc.h>
+#include "hal.h"
 
 #ifndef TIMER_H
 #define TIMER_H
@@ -8,11 +8,53 @@
 #define TIMER3 3
 #define TIMER4 4
 
+// Timer period as register values: TCKPS prescaler index and PR, for a
+// period of (pr + 1) * prescaler cycles
+struct TmrPeriod {
+	unsigned int tckps;
+	unsigned int pr;
+};
 
-void tmr_setup_period(int timer, int ms);
+#define TMR_MAX_TICKS 0x10000UL
+#define TMR_PRESCALER(tckps) ((tckps) == 0 ? 1UL : (tckps) == 1 ? 8UL : (tckps) == 2 ? 64UL : 256UL)
+
+#define TMR_CYCLES(us) (FCY / 1000000UL * (unsigned long)(us))
+// smallest prescaler that fits the period, i.e. the best resolution
+#define TMR_TCKPS(us) \
+	(TMR_CYCLES(us) <= TMR_MAX_TICKS ? 0 : \
+	 TMR_CYCLES(us) <= 8 * TMR_MAX_TICKS ? 1 : \
+	 TMR_CYCLES(us) <= 64 * TMR_MAX_TICKS ? 2 : 3)
+#define TMR_TICKS(us) \
+	((TMR_CYCLES(us) + TMR_PRESCALER(TMR_TCKPS(us)) / 2) / TMR_PRESCALER(TMR_TCKPS(us)))
+
+/*
+Period descriptors evaluated by the compiler, us (or ms) must be an integer
+constant expression. Periods from 1 us up to 233 ms are accepted, anything
+else fails to compile (negative bit-field width).
+Example: tmr_setup_period(TIMER2, TMR_PERIOD_US(250));
+*/
+#define TMR_PERIOD_US(us) ((struct TmrPeriod){ \
+	.tckps = TMR_TCKPS(us), \
+	.pr = (unsigned int)(TMR_TICKS(us) - 1) + 0 * sizeof(struct { \
+		int tmr_period_out_of_range : (us) > 0 && TMR_CYCLES(us) <= 256 * TMR_MAX_TICKS ? 1 : -1; \
+	}), \
+})
+#define TMR_PERIOD_MS(ms) TMR_PERIOD_US((ms) * 1000UL)
+
+// stops the timer, loads the period and restarts it from 0, only register
+// writes
+void tmr_setup_period(int timer, struct TmrPeriod period);
 
 int tmr_wait_period(int timer);
 
+/*
+Same as tmr_wait_period(), but the CPU sits in Idle mode until the period
+ends instead of polling the flag, waking up only to serve the interrupts.
+idle is set to the timer ticks spent in Idle. TIMER3 drives the software
+timers and falls back to tmr_wait_period().
+*/
+int tmr_idle_period(int timer, unsigned int *idle);
+
 void tmr_wait_ms(int timer, int ms);
 
 #endif
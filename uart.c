@@ -1,47 +1,225 @@
 #include "uart.h"
-#include <xc.h>
+#include "hal.h"
 
-int UART_INTERRUPT_TX_MANUAL_TRIG = 1; 
+#include <stdlib.h>
 
-void init_uart() {
+#define DMA_IRQ_U1TX 0x0C
+
+// The output lanes are drained by DMA channel 0 one contiguous span at a
+// time: the channel moves a byte on every UART1 TX request and interrupts
+// once the span is sent, then the next span is handed over. A lane is picked
+// in priority order and kept up to its head at that time (keep), which is
+// the end of a message, so the messages of different lanes never interleave.
+// The consumer side of the lanes is owned by whoever finds the channel idle:
+// uart_tx_start() when tx_busy is clear, the DMA interrupt otherwise.
+static struct OutLane *tx_lanes;
+static int tx_n_lanes;
+static struct OutLane *tx_lane; // lane of the transfer in flight
+static volatile int tx_busy;
+static unsigned int tx_len; // bytes of the transfer in flight
+
+// requested rate change, the transfers stop at the hold of every lane (its
+// head at the time of the request) while baud_switch is set
+static struct UartBaud baud_next;
+static volatile int baud_switch;
+
+struct UartRxErrors uart_rx_errors;
+
+static void set_baud(const struct UartBaud *cfg) {
+    U1MODEbits.BRGH = cfg->brgh;
+    U1BRG = cfg->brg;
+}
+
+void init_uart(struct OutLane *lanes, int n_lanes) {
     RPINR18bits.U1RXR = 0b1001011; // mapping pin RD11(RPI75) to UART RX
     RPOR0bits.RP64R = 0b000001; // mapping pin RD0(RP64) to UART TX
 
-    U1BRG = 467; // baud rate to 9600 -> 72 000 000 / (16 * 9600) - 1
+    struct UartBaud cfg;
+    uart_baud_config(UART_DEFAULT_BAUD, &cfg); // 9600 -> BRGH, 72 000 000 / (4 * 9600) - 1
+    set_baud(&cfg);
 
-    U1STAbits.URXISEL = 0; // set to interrupt on char received
+    uart_set_rx_threshold(UART_RX_THRESHOLD);
     U1MODEbits.UARTEN = 1; // enable UART
     U1STAbits.UTXEN = 1; // enable UART transmission
     
+    // TX request on every character moved to the shift register, it only
+    // triggers the DMA, the CPU interrupt stays disabled
     U1STAbits.UTXISEL0 = 0;
-    U1STAbits.UTXISEL1 = 1;
+    U1STAbits.UTXISEL1 = 0;
+
+    tx_lanes = lanes;
+    tx_n_lanes = n_lanes;
+    DMA0CONbits.SIZE = 1; // byte transfers
+    DMA0CONbits.DIR = 1; // from RAM to the peripheral
+    DMA0CONbits.AMODE = 0; // register indirect with post-increment
+    DMA0CONbits.MODE = 0b01; // one-shot, ping-pong disabled
+    DMA0REQbits.IRQSEL = DMA_IRQ_U1TX;
+    HAL_DMA0_PERIPHERAL(&U1TXREG);
 
     IFS0bits.U1RXIF = 0; // interrupt flag set to 0
     IEC0bits.U1RXIE = 1; // enabled interrupt on receive
-    IEC0bits.U1TXIE = 1; // enabled interrupt on transmission
+    IFS0bits.DMA0IF = 0;
+    IEC0bits.DMA0IE = 1; // enabled interrupt on end of transfer
+}
 
+// first lane with something to send, in priority order. The empty mailbox
+// lanes are filled here, unless a rate switch holds the new output back
+static struct OutLane *tx_pick_lane() {
+    for(int i = 0; i < tx_n_lanes; ++i) {
+        struct OutLane *lane = &tx_lanes[i];
+        if(lane->mailbox && !baud_switch && lane->ring->tail == lane->ring->head) {
+            outq_pull(lane);
+        }
+        const unsigned int end = baud_switch ? lane->hold : HAL_LOAD_ACQUIRE(&lane->ring->head);
+        if(end != lane->ring->tail) {
+            lane->keep = end;
+            return lane;
+        }
+    }
+    return 0;
 }
 
-void print_to_buff(const char * str, struct circular_buffer *buff) {
-    if(!str) {
-        return; 
+// hands the next contiguous span of the current lane, or of the next one
+// once the lane reached keep, to the idle channel, returns 0 if there is
+// nothing to send
+static int tx_dma_next() {
+    if(!tx_lane || tx_lane->ring->tail == tx_lane->keep) {
+        tx_lane = tx_pick_lane();
+        if(!tx_lane) {
+            return 0;
+        }
     }
-    
-    for (int i = 0; str[i] != '\0'; ++i) {
-        const int new_write_index = (buff->write + 1) % buff->len;
 
-        if(new_write_index == buff->read) {
-            break;
+    const char *span;
+    tx_len = ring_span(tx_lane->ring, &span);
+    const unsigned int left = tx_lane->keep - tx_lane->ring->tail;
+    if(tx_len > left) {
+        tx_len = left;
+    }
+
+    HAL_DMA0_SOURCE(span);
+    DMA0CNT = tx_len - 1;
+    DMA0CONbits.CHEN = 1;
+    // with a full TX buffer the next character moved to the shift register
+    // requests the first byte, otherwise no request would come: force it
+    if(!U1STAbits.UTXBF) {
+        DMA0REQbits.FORCE = 1;
+    }
+    return 1;
+}
+
+void uart_tx_start() {
+    // tx_busy must be read after the data is published: read before, the
+    // DMA interrupt could find the ring still empty and stop the channel
+    // after we saw it busy, leaving the data unsent
+    HAL_BARRIER();
+    if(!tx_busy) {
+        // claimed before starting: a short transfer may complete, and the
+        // interrupt update the flag, before tx_dma_next() returns
+        tx_busy = 1;
+        if(!tx_dma_next()) {
+            tx_busy = 0;
         }
+    }
+}
 
-        buff->buff[buff->write] = str[i];
-        buff->write = new_write_index;
+int uart_set_rx_threshold(int chars) {
+    switch(chars) {
+        case 1: U1STAbits.URXISEL = 0b00; break; // every character
+        case 3: U1STAbits.URXISEL = 0b10; break;
+        case 4: U1STAbits.URXISEL = 0b11; break; // FIFO full
+        default: return -1;
     }
+    return 0;
+}
 
-    // if the last UART transfer didn't send any data we retrigger the interrupt
-    // manually to send the new data
-    if(UART_INTERRUPT_TX_MANUAL_TRIG){
-        UART_INTERRUPT_TX_MANUAL_TRIG = 0;
-        IFS0bits.U1TXIF = 1;
+int uart_rx_read(char *c) {
+    if(U1STAbits.URXDA) {
+        // the error bits are the ones of the character at the top of the
+        // FIFO, they have to be read before it
+        const int framing = U1STAbits.FERR;
+        const int parity = U1STAbits.PERR;
+        *c = HAL_U1_READ();
+        if(framing) {
+            ++uart_rx_errors.framing;
+            return UART_RX_ERROR;
+        }
+        if(parity) {
+            ++uart_rx_errors.parity;
+            return UART_RX_ERROR;
+        }
+        return UART_RX_BYTE;
     }
+    if(U1STAbits.OERR) {
+        // clearing it empties the FIFO, so only once the good characters
+        // received before the overrun are read
+        ++uart_rx_errors.overruns;
+        U1STAbits.OERR = 0;
+        return UART_RX_ERROR;
+    }
+    return UART_RX_NONE;
+}
+
+int uart_rx_idle(void) {
+    return U1STAbits.URXDA && U1STAbits.RIDLE;
+}
+
+int uart_rx_quiet(void) {
+    return !U1STAbits.URXDA && U1STAbits.RIDLE;
+}
+
+int uart_baud_config(unsigned long baud, struct UartBaud *cfg) {
+    cfg->error = 0x7FFF;
+    if(baud == 0 || baud > UART_MAX_BAUD) {
+        return -1;
+    }
+
+    for(unsigned int brgh = 0; brgh <= 1; ++brgh) {
+        const unsigned long clocks = (brgh ? 4UL : 16UL) * baud; // per second
+        const unsigned long div = (FCY + clocks / 2) / clocks; // brg + 1
+        if(div == 0 || div > 0x10000UL) {
+            continue;
+        }
+        // rate / baud - 1 = FCY / (clocks * div) - 1, clocks * div is close
+        // to FCY so the division by 10000 loses almost nothing
+        const unsigned long actual = clocks * div;
+        const int error = (int)(((long)FCY - (long)actual) / (long)(actual / 10000));
+        if(abs(error) < abs(cfg->error)) {
+            cfg->brg = (unsigned int)(div - 1);
+            cfg->brgh = brgh;
+            cfg->error = error;
+        }
+    }
+    return abs(cfg->error) <= UART_MAX_BAUD_ERROR ? 0 : -1;
+}
+
+int uart_request_baud(unsigned long baud) {
+    struct UartBaud cfg;
+    if(uart_baud_config(baud, &cfg) < 0) {
+        return -1;
+    }
+    baud_next = cfg;
+    for(int i = 0; i < tx_n_lanes; ++i) {
+        tx_lanes[i].hold = tx_lanes[i].ring->head;
+    }
+    HAL_BARRIER();
+    baud_switch = 1;
+    return 0;
+}
+
+void uart_baud_step() {
+    // nothing in flight in the DMA nor in the UART buffer and shift register
+    if(!baud_switch || tx_busy || !U1STAbits.TRMT) {
+        return;
+    }
+    set_baud(&baud_next);
+    baud_switch = 0;
+    uart_tx_start(); // what was held back
+}
+
+void HAL_ISR _DMA0Interrupt(void) {
+    IFS0bits.DMA0IF = 0;
+
+    ring_consume(tx_lane->ring, tx_len);
+    tx_busy = tx_dma_next();
 }
\ No newline at end of file
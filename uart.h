@@ -1,21 +1,86 @@
 #ifndef UART_H
 #define	UART_H
 
-#include <xc.h>
+#include "hal.h"
+#include "ring.h"
+#include "outq.h"
 
 
-// flag used to manually trigger the UART interrupt on new data
-extern int UART_INTERRUPT_TX_MANUAL_TRIG; 
+#define UART_DEFAULT_BAUD 9600UL
+#define UART_MAX_BAUD 1000000UL
+#define UART_MAX_BAUD_ERROR 200 // hundredths of a percent
+#define UART_RX_THRESHOLD 3 // characters in the receive FIFO that raise the RX interrupt
 
-struct circular_buffer {
-    char *buff;
-    int read;
-    int write;
+// uart_rx_read() results
+#define UART_RX_NONE 0 // the FIFO is empty
+#define UART_RX_BYTE 1 // a good character was read
+#define UART_RX_ERROR (-1) // characters were lost or discarded, the stream has a gap
 
-    int len;
+// receive errors, counted by uart_rx_read()
+struct UartRxErrors {
+    unsigned int overruns; // OERR: the FIFO was full, the following characters were lost
+    unsigned int framing; // FERR: missing stop bit, the character is discarded
+    unsigned int parity; // PERR: the character is discarded
 };
+extern struct UartRxErrors uart_rx_errors;
 
-void init_uart();
-void print_to_buff(const char * str, struct circular_buffer *buff);
+// U1BRG and BRGH for a rate: FCY / (16 * (brg + 1)), or FCY / (4 * (brg + 1))
+// in high speed mode
+struct UartBaud {
+    unsigned int brg;
+    unsigned int brgh;
+    int error; // actual rate against the requested one, hundredths of a percent
+};
+
+// sets up UART1 at UART_DEFAULT_BAUD and the DMA channel that drains the
+// output lanes, lanes[0] has the highest priority. The RX interrupt comes
+// every UART_RX_THRESHOLD characters
+void init_uart(struct OutLane *lanes, int n_lanes);
+
+/*
+Characters in the 4 deep receive FIFO that raise the RX interrupt: 1, 3 or
+4, returns -1 for the other values. Fewer interrupts, but a batch shorter than
+the threshold is only seen by uart_rx_idle() and the FIFO has less room left
+for the interrupt latency: 3 characters of time at 1, 1 at 3 and none at 4.
+*/
+int uart_set_rx_threshold(int chars);
+
+/*
+Reads the next character of the receive FIFO. Characters with a framing or
+parity error are discarded and counted; an overrun is reported once the FIFO
+is drained, then cleared, which restarts the receiver (it stops at the first
+overrun and stays stopped until then). Returns one of UART_RX_*.
+*/
+int uart_rx_read(char *c);
+
+// 1 if characters are waiting in the FIFO and none is being received: the
+// tail of a batch under the threshold, which raises no interrupt
+int uart_rx_idle(void);
+
+// 1 if the FIFO is empty and no character is being received
+int uart_rx_quiet(void);
+
+/*
+Finds the divider closest to the requested rate, preferring the 16x mode on
+ties. Returns -1 if the rate is 0 or above UART_MAX_BAUD, or if the closest
+achievable one is more than UART_MAX_BAUD_ERROR off (cfg is filled anyway).
+*/
+int uart_baud_config(unsigned long baud, struct UartBaud *cfg);
+
+/*
+Switches UART1 to a new rate once the output already queued has been sent at
+the old one, what is written afterwards waits in its lane and goes out at the
+new rate. The switch is applied by uart_baud_step(). Returns -1, keeping the
+current rate, if uart_baud_config() rejects the rate.
+*/
+int uart_request_baud(unsigned long baud);
+
+// to be called periodically, applies a requested rate when the transmitter
+// is idle
+void uart_baud_step();
+
+// to be called after writing to an output lane, starts a DMA transfer if
+// the transmitter is idle
+void uart_tx_start();
 
-#endif	/* UART_H */
\ No newline at end of file
+#endif	/* UART_H */